@@ -0,0 +1,98 @@
+/*
+ * SDyn: Bump-pointer arenas for compile-time data
+ *
+ * Copyright (c) 2015 Gregor Richards
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sdyn/arena.h"
+
+/* chunks are at least this big */
+#define ARENA_CHUNK_SZ 65536
+
+/* everything in the arena is aligned to this */
+#define ARENA_ALIGN sizeof(void *)
+
+/* the data in a chunk follows its header */
+#define CHUNK_HEADER_SZ ((sizeof(struct SDyn_ArenaChunk) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+#define CHUNK_DATA(chunk) ((unsigned char *) (chunk) + CHUNK_HEADER_SZ)
+
+/* initialize an (empty) arena */
+void sdyn_arenaInit(struct SDyn_Arena *arena)
+{
+    arena->chunk = NULL;
+}
+
+/* allocate zeroed space in an arena */
+void *sdyn_arenaAlloc(struct SDyn_Arena *arena, size_t sz)
+{
+    struct SDyn_ArenaChunk *chunk = arena->chunk;
+    void *ret;
+
+    sz = (sz + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    /* need a new chunk? */
+    if (!chunk || chunk->size - chunk->used < sz) {
+        size_t csz = ARENA_CHUNK_SZ;
+        if (csz < sz) csz = sz;
+
+        chunk = malloc(CHUNK_HEADER_SZ + csz);
+        if (!chunk) {
+            perror("malloc");
+            abort();
+        }
+        chunk->size = csz;
+        chunk->used = 0;
+
+        /* a huge allocation goes in its own chunk behind the current one, so
+         * the current one can still be used */
+        if (arena->chunk && csz == sz) {
+            chunk->next = arena->chunk->next;
+            arena->chunk->next = chunk;
+        } else {
+            chunk->next = arena->chunk;
+            arena->chunk = chunk;
+        }
+    }
+
+    ret = CHUNK_DATA(chunk) + chunk->used;
+    chunk->used += sz;
+    memset(ret, 0, sz);
+
+    return ret;
+}
+
+/* reallocate space in an arena. The old space is simply abandoned */
+void *sdyn_arenaRealloc(struct SDyn_Arena *arena, void *old, size_t oldSz, size_t sz)
+{
+    void *ret = sdyn_arenaAlloc(arena, sz);
+    if (old) memcpy(ret, old, (oldSz < sz) ? oldSz : sz);
+    return ret;
+}
+
+/* free everything in an arena */
+void sdyn_arenaFree(struct SDyn_Arena *arena)
+{
+    struct SDyn_ArenaChunk *chunk, *next;
+
+    for (chunk = arena->chunk; chunk; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+    arena->chunk = NULL;
+}
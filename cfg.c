@@ -0,0 +1,336 @@
+/*
+ * SDyn: Control flow and dominator analysis of IR
+ *
+ * Copyright (c) 2015 Gregor Richards
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * This is an analysis, not a representation: the IR itself remains a flat
+ * array, with control flow implied by the IF/IFELSE/IFEND and WHILE/WCOND/WEND
+ * markers and merges by UNIFY nodes, which is what the passes transform and the
+ * JIT compiles. This file derives a CFG from those markers, in which basic
+ * blocks are contiguous ranges of IR nodes, and computes dominators (using the
+ * algorithm of Cooper, Harvey and Kennedy) and loop nesting over it. Passes use
+ * it to answer questions the markers make awkward. It's built afresh where it's
+ * wanted, rather than kept up to date as the IR changes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sdyn/cfg.h"
+#include "sdyn/ir.h"
+
+/* add an edge */
+static void addSucc(struct SDyn_IRBlock *block, size_t succ)
+{
+    block->succs[block->succCount++] = succ;
+}
+
+/* find the blocks and the edges between them */
+static void cfgBlocks(struct SDyn_IR *ir, struct SDyn_CFG *cfg)
+{
+    struct SDyn_Arena *arena = ir->arena;
+    struct SDyn_IRBlock *block;
+    char *leader;
+    size_t *partner;
+    size_t i, b, last, epilogue;
+
+    /* first mark the nodes which begin blocks */
+    leader = sdyn_arenaAlloc(arena, ir->length + 1);
+    leader[0] = 1;
+    epilogue = ir->length;
+    for (i = 0; i < ir->length; i++) {
+        switch (ir->op[i]) {
+            case SDYN_NODE_IF:
+            case SDYN_NODE_IFELSE:
+            case SDYN_NODE_WCOND:
+            case SDYN_NODE_WEND:
+            case SDYN_NODE_RETURN:
+                /* these all end their block */
+                leader[i + 1] = 1;
+                break;
+
+            case SDYN_NODE_PPOPA:
+                /* the epilogue, which all returns jump to */
+                if (epilogue == ir->length) epilogue = i;
+                /* fallthrough */
+
+            case SDYN_NODE_IFEND:
+            case SDYN_NODE_WHILE:
+                /* these are jumped to */
+                leader[i] = 1;
+                break;
+        }
+    }
+
+    /* number the blocks */
+    cfg->nodeBlock = sdyn_arenaAlloc(arena, ir->length * sizeof(size_t));
+    cfg->blockCount = 0;
+    for (i = 0; i < ir->length; i++) {
+        if (leader[i]) cfg->blockCount++;
+        cfg->nodeBlock[i] = cfg->blockCount - 1;
+    }
+    cfg->blocks = sdyn_arenaAlloc(arena, cfg->blockCount * sizeof(struct SDyn_IRBlock));
+    for (i = 0; i < ir->length; i++) {
+        block = &cfg->blocks[cfg->nodeBlock[i]];
+        if (leader[i]) block->start = i;
+        block->end = i + 1;
+    }
+
+    /* the markers refer backwards, to the IF of an IFELSE, etc. To find our
+     * jump targets, we need the opposite */
+    partner = sdyn_arenaAlloc(arena, ir->length * sizeof(size_t));
+    for (i = 0; i < ir->length; i++) {
+        switch (ir->op[i]) {
+            case SDYN_NODE_IFELSE:
+            case SDYN_NODE_IFEND:
+                partner[ir->left[i]] = i;
+                break;
+
+            case SDYN_NODE_WEND:
+                partner[ir->right[i]] = i;
+                break;
+        }
+    }
+
+    /* now make the edges */
+#define BLOCK_AT(n) cfg->nodeBlock[n]
+    for (b = 0; b < cfg->blockCount; b++) {
+        block = &cfg->blocks[b];
+        last = block->end - 1;
+
+        switch (ir->op[last]) {
+            case SDYN_NODE_IF:
+                /* into the if, or the else */
+                addSucc(block, BLOCK_AT(last + 1));
+                addSucc(block, BLOCK_AT(partner[last] + 1));
+                break;
+
+            case SDYN_NODE_IFELSE:
+                /* out of the if */
+                addSucc(block, BLOCK_AT(partner[last]));
+                break;
+
+            case SDYN_NODE_WCOND:
+                /* into the loop body, or out of the loop */
+                addSucc(block, BLOCK_AT(last + 1));
+                addSucc(block, BLOCK_AT(partner[last] + 1));
+                break;
+
+            case SDYN_NODE_WEND:
+                /* back to the loop header */
+                addSucc(block, BLOCK_AT(ir->left[last]));
+                break;
+
+            case SDYN_NODE_RETURN:
+                if (epilogue < ir->length)
+                    addSucc(block, BLOCK_AT(epilogue));
+                break;
+
+            default:
+                /* fall through */
+                if (block->end < ir->length)
+                    addSucc(block, BLOCK_AT(block->end));
+        }
+    }
+#undef BLOCK_AT
+
+    /* and the reverse edges */
+    for (b = 0; b < cfg->blockCount; b++) {
+        block = &cfg->blocks[b];
+        for (i = 0; i < block->succCount; i++)
+            cfg->blocks[block->succs[i]].predCount++;
+    }
+    for (b = 0; b < cfg->blockCount; b++) {
+        block = &cfg->blocks[b];
+        block->preds = sdyn_arenaAlloc(arena, block->predCount * sizeof(size_t));
+        block->predCount = 0;
+    }
+    for (b = 0; b < cfg->blockCount; b++) {
+        block = &cfg->blocks[b];
+        for (i = 0; i < block->succCount; i++) {
+            struct SDyn_IRBlock *succ = &cfg->blocks[block->succs[i]];
+            succ->preds[succ->predCount++] = b;
+        }
+    }
+}
+
+/* order the reachable blocks in reverse postorder */
+static void cfgOrder(struct SDyn_IR *ir, struct SDyn_CFG *cfg)
+{
+    struct SDyn_IRBlock *block;
+    size_t *stack, *nextSucc;
+    size_t sp, b, s, post;
+
+    stack = sdyn_arenaAlloc(ir->arena, cfg->blockCount * sizeof(size_t));
+    nextSucc = sdyn_arenaAlloc(ir->arena, cfg->blockCount * sizeof(size_t));
+    cfg->order = sdyn_arenaAlloc(ir->arena, cfg->blockCount * sizeof(size_t));
+
+    /* depth-first search from the entry */
+    post = 0;
+    sp = 0;
+    stack[sp++] = 0;
+    cfg->blocks[0].reachable = 1;
+    while (sp) {
+        b = stack[sp - 1];
+        block = &cfg->blocks[b];
+        if (nextSucc[b] < block->succCount) {
+            s = block->succs[nextSucc[b]++];
+            if (!cfg->blocks[s].reachable) {
+                cfg->blocks[s].reachable = 1;
+                stack[sp++] = s;
+            }
+        } else {
+            /* finished with this one */
+            cfg->order[post++] = b;
+            sp--;
+        }
+    }
+
+    /* reverse it */
+    cfg->orderCount = post;
+    for (s = 0; s < post / 2; s++) {
+        b = cfg->order[s];
+        cfg->order[s] = cfg->order[post - s - 1];
+        cfg->order[post - s - 1] = b;
+    }
+    for (s = 0; s < post; s++)
+        cfg->blocks[cfg->order[s]].rpo = s;
+}
+
+/* compute immediate dominators */
+static void cfgDominators(struct SDyn_CFG *cfg)
+{
+    struct SDyn_IRBlock *block;
+    size_t oi, pi, b, p, newIdom, f1, f2;
+    int changed;
+
+    for (b = 0; b < cfg->blockCount; b++)
+        cfg->blocks[b].idom = SDYN_NO_BLOCK;
+    cfg->blocks[0].idom = 0;
+
+    do {
+        changed = 0;
+        for (oi = 1; oi < cfg->orderCount; oi++) {
+            b = cfg->order[oi];
+            block = &cfg->blocks[b];
+
+            /* intersect the dominators of all processed predecessors */
+            newIdom = SDYN_NO_BLOCK;
+            for (pi = 0; pi < block->predCount; pi++) {
+                p = block->preds[pi];
+                if (cfg->blocks[p].idom == SDYN_NO_BLOCK) continue;
+                if (newIdom == SDYN_NO_BLOCK) {
+                    newIdom = p;
+                    continue;
+                }
+
+                f1 = p;
+                f2 = newIdom;
+                while (f1 != f2) {
+                    while (cfg->blocks[f1].rpo > cfg->blocks[f2].rpo)
+                        f1 = cfg->blocks[f1].idom;
+                    while (cfg->blocks[f2].rpo > cfg->blocks[f1].rpo)
+                        f2 = cfg->blocks[f2].idom;
+                }
+                newIdom = f1;
+            }
+
+            if (block->idom != newIdom) {
+                block->idom = newIdom;
+                changed = 1;
+            }
+        }
+    } while (changed);
+
+    /* the entry has no dominator */
+    cfg->blocks[0].idom = SDYN_NO_BLOCK;
+}
+
+/* find natural loops and their nesting */
+static void cfgLoops(struct SDyn_IR *ir, struct SDyn_CFG *cfg)
+{
+    struct SDyn_IRBlock *block, *header;
+    size_t *mark, *stack;
+    size_t oi, pi, sp, h, b, p;
+
+    /* every block has at most two successors, so there are at most twice as
+     * many edges to push as blocks */
+    mark = sdyn_arenaAlloc(ir->arena, cfg->blockCount * sizeof(size_t));
+    stack = sdyn_arenaAlloc(ir->arena, cfg->blockCount * 2 * sizeof(size_t));
+    for (b = 0; b < cfg->blockCount; b++)
+        cfg->blocks[b].loopHeader = SDYN_NO_BLOCK;
+
+    /* outer loop headers come before inner ones in reverse postorder, so
+     * inner loops override the loopHeader of outer ones */
+    for (oi = 0; oi < cfg->orderCount; oi++) {
+        h = cfg->order[oi];
+        header = &cfg->blocks[h];
+
+        /* any predecessor this block dominates is the source of a back edge */
+        sp = 0;
+        for (pi = 0; pi < header->predCount; pi++) {
+            p = header->preds[pi];
+            if (cfg->blocks[p].reachable && sdyn_cfgDominates(cfg, h, p))
+                stack[sp++] = p;
+        }
+        if (!sp) continue;
+
+        /* it's a loop header. Walk back from the latches to find the body */
+        mark[h] = h + 1;
+        header->loopDepth++;
+        header->loopHeader = h;
+        while (sp) {
+            b = stack[--sp];
+            if (mark[b] == h + 1) continue;
+            mark[b] = h + 1;
+            block = &cfg->blocks[b];
+            block->loopDepth++;
+            block->loopHeader = h;
+            for (pi = 0; pi < block->predCount; pi++) {
+                p = block->preds[pi];
+                if (cfg->blocks[p].reachable && mark[p] != h + 1)
+                    stack[sp++] = p;
+            }
+        }
+    }
+}
+
+/* build the CFG for this IR, with dominators and loop nesting */
+struct SDyn_CFG *sdyn_irBuildCFG(struct SDyn_IR *ir)
+{
+    struct SDyn_CFG *cfg;
+
+    cfg = sdyn_arenaAlloc(ir->arena, sizeof(struct SDyn_CFG));
+    if (!ir->length) return cfg;
+
+    cfgBlocks(ir, cfg);
+    cfgOrder(ir, cfg);
+    cfgDominators(cfg);
+    cfgLoops(ir, cfg);
+
+    return cfg;
+}
+
+/* does block a dominate block b? */
+int sdyn_cfgDominates(struct SDyn_CFG *cfg, size_t a, size_t b)
+{
+    while (b != SDYN_NO_BLOCK) {
+        if (a == b) return 1;
+        b = cfg->blocks[b].idom;
+    }
+    return 0;
+}
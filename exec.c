@@ -25,29 +25,31 @@
 /* execute this code */
 void sdyn_exec(const unsigned char *code)
 {
-    SDyn_Node pnode = NULL, cnode = NULL;
-    SDyn_NodeArray children = NULL;
+    struct SDyn_Arena arena;
+    struct SDyn_Node *pnode, *cnode;
+    struct SDyn_NodeArray *children;
     SDyn_String name = NULL;
     SDyn_Function func = NULL;
     size_t i;
 
-    GGC_PUSH_5(pnode, cnode, children, name, func);
+    GGC_PUSH_2(name, func);
 
-    /* parse it */
-    pnode = sdyn_parse(code);
-    children = GGC_RP(pnode, children);
+    /* pre-parse it. Functions are fully parsed when they're first called */
+    sdyn_arenaInit(&arena);
+    pnode = sdyn_preparse(&arena, code);
+    children = pnode->children;
 
     /* load everything in */
     for (i = 0; i < children->length; i++) {
-        cnode = GGC_RAP(children, i);
-        name = sdyn_boxString(NULL, (char *) GGC_RD(cnode, tok).val, GGC_RD(cnode, tok).valLen);
+        cnode = children->a[i];
+        name = sdyn_internString(NULL, (char *) cnode->tok.val, cnode->tok.valLen);
 
-        if (GGC_RD(cnode, type) == SDYN_NODE_FUNDECL) {
+        if (cnode->type == SDYN_NODE_LAZYFUNDECL) {
             /* add function to global object */
             func = sdyn_boxFunction(cnode);
             sdyn_setObjectMember(NULL, sdyn_globalObject, name, (SDyn_Undefined) func);
 
-        } else if (GGC_RD(cnode, type) == SDYN_NODE_VARDECL) {
+        } else if (cnode->type == SDYN_NODE_VARDECL) {
             /* add variable to global object */
             sdyn_getObjectMemberIndex(NULL, sdyn_globalObject, name, 1);
 
@@ -56,9 +58,9 @@ void sdyn_exec(const unsigned char *code)
 
     /* then execute global calls */
     for (i = 0; i < children->length; i++) {
-        cnode = GGC_RAP(children, i);
-        name = sdyn_boxString(NULL, (char *) GGC_RD(cnode, tok).val, GGC_RD(cnode, tok).valLen);
-        if (GGC_RD(cnode, type) == SDYN_NODE_GLOBALCALL) {
+        cnode = children->a[i];
+        name = sdyn_internString(NULL, (char *) cnode->tok.val, cnode->tok.valLen);
+        if (cnode->type == SDYN_NODE_GLOBALCALL) {
             /* call a global function */
             func = (SDyn_Function) sdyn_getObjectMember(NULL, sdyn_globalObject, name);
             sdyn_assertFunction(NULL, func);
@@ -66,4 +68,6 @@ void sdyn_exec(const unsigned char *code)
 
         }
     }
+
+    sdyn_arenaFree(&arena);
 }
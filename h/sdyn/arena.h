@@ -0,0 +1,49 @@
+/*
+ * SDyn: Bump-pointer arenas for compile-time data
+ *
+ * Copyright (c) 2015 Gregor Richards
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef SDYN_ARENA_H
+#define SDYN_ARENA_H 1
+
+#include <sys/types.h>
+
+/* The parse tree and IR only live as long as it takes to compile a function,
+ * so rather than putting them in the GC'd heap, they're allocated from an
+ * arena which is freed all at once when compilation is done. Nothing in an
+ * arena may point to GC'd objects. */
+struct SDyn_ArenaChunk {
+    struct SDyn_ArenaChunk *next;
+    size_t size, used;
+};
+
+struct SDyn_Arena {
+    struct SDyn_ArenaChunk *chunk;
+};
+
+/* initialize an (empty) arena */
+void sdyn_arenaInit(struct SDyn_Arena *arena);
+
+/* allocate zeroed space in an arena */
+void *sdyn_arenaAlloc(struct SDyn_Arena *arena, size_t sz);
+
+/* reallocate space in an arena. The old space is simply abandoned */
+void *sdyn_arenaRealloc(struct SDyn_Arena *arena, void *old, size_t oldSz, size_t sz);
+
+/* free everything in an arena */
+void sdyn_arenaFree(struct SDyn_Arena *arena);
+
+#endif
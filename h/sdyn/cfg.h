@@ -0,0 +1,61 @@
+/*
+ * SDyn: Control flow and dominator analysis of IR
+ *
+ * Copyright (c) 2015 Gregor Richards
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef SDYN_CFG_H
+#define SDYN_CFG_H 1
+
+#include <stdlib.h>
+
+struct SDyn_IR;
+
+/* "no block", e.g. the immediate dominator of the entry block */
+#define SDYN_NO_BLOCK ((size_t) -1)
+
+/* a basic block: a contiguous range of IR nodes */
+struct SDyn_IRBlock {
+    size_t start, end; /* the nodes in this block are [start, end) */
+
+    /* Edges: */
+    size_t succs[2], succCount;
+    size_t *preds, predCount;
+
+    /* Analysis: */
+    int reachable;
+    size_t rpo; /* index in reverse postorder */
+    size_t idom; /* immediate dominator */
+    size_t loopHeader; /* header of the innermost loop containing this block */
+    int loopDepth; /* number of loops containing this block */
+};
+
+/* a function's CFG, derived from the control flow markers in its IR. It only
+ * describes the IR, which remains the flat array of nodes. */
+struct SDyn_CFG {
+    size_t blockCount;
+    struct SDyn_IRBlock *blocks;
+    size_t *nodeBlock; /* the block containing each IR node */
+    size_t *order; /* reachable blocks in reverse postorder */
+    size_t orderCount;
+};
+
+/* build the CFG for this IR, with dominators and loop nesting */
+struct SDyn_CFG *sdyn_irBuildCFG(struct SDyn_IR *ir);
+
+/* does block a dominate block b? */
+int sdyn_cfgDominates(struct SDyn_CFG *cfg, size_t a, size_t b);
+
+#endif
@@ -19,8 +19,8 @@
 #ifndef SDYN_IR_H
 #define SDYN_IR_H 1
 
-#include "ggggc/gc.h"
-
+#include "arena.h"
+#include "cfg.h"
 #include "nodes.h"
 #include "parser.h"
 
@@ -40,35 +40,92 @@ struct SDyn_RegisterMap {
     unsigned char usable[1];
 };
 
-GGC_TYPE(SDyn_IRNode)
+/* functions may be compiled specialized to the types of this many of their
+ * arguments (including "this") */
+#define SDYN_SPECIALIZE_ARGS 5
+
+/* IR lives in an arena along with the parse tree, so nothing in it may refer
+ * to GC'd objects. Strings are referred to by their source text, and only
+ * boxed by the JIT. */
+
+/* a single IR node, as built by the IR compiler before being added to the IR */
+struct SDyn_IRNode {
+    /* Operation */
+    int op;
+    int rtype; /* result type of this operation */
+
+    /* Operands: */
+    long imm; /* any immediate operand */
+    const unsigned char *str; /* any string immediate operand (source text) */
+    size_t strLen;
+    size_t left; /* the left operand */
+    size_t right; /* the right operand */
+    size_t third; /* the third operand, if applicable */
+};
+
+/* a string operand, kept in a side table since few nodes have one */
+struct SDyn_IRString {
+    size_t node; /* the node this string belongs to */
+    const unsigned char *str;
+    size_t strLen;
+};
+
+/* a function's IR, stored as parallel arrays indexed by node */
+struct SDyn_IR {
+    struct SDyn_Arena *arena;
+    size_t length, capacity;
+
     /* Operation */
-    GGC_MDATA(int, op);
-    GGC_MDATA(int, rtype); /* result type of this operation */
+    int *op;
+    int *rtype; /* result type of this operation */
 
     /* Operands: */
-    GGC_MDATA(long, imm); /* any immediate operand */
-    GGC_MPTR(void *, immp); /* any pointer immediate operand */
-    GGC_MDATA(size_t, left); /* the left operand */
-    GGC_MDATA(size_t, right); /* the right operand */
-    GGC_MDATA(size_t, third); /* the third operand, if applicable */
+    long *imm; /* any immediate operand */
+    size_t *left; /* the left operand */
+    size_t *right; /* the right operand */
+    size_t *third; /* the third operand, if applicable */
 
     /* Register allocation: */
-    GGC_MDATA(int, stype); /* the storage type in which to place the result */
-    GGC_MDATA(size_t, addr); /* the address this value is assigned to */
-    GGC_MDATA(size_t, uidx); /* the index after unification */
-    GGC_MPTR(GGC_size_t_Array, lastUsed); /* values used no later than here */
-GGC_END_TYPE(SDyn_IRNode,
-    GGC_PTR(SDyn_IRNode, immp)
-    GGC_PTR(SDyn_IRNode, lastUsed)
-    );
-
-/* compile a function to IR */
-SDyn_IRNodeArray sdyn_irCompilePrime(SDyn_Node func);
+    int *stype; /* the storage type in which to place the result */
+    size_t *addr; /* the address this value is assigned to */
+    size_t *uidx; /* the index after unification */
+
+    /* Dependencies, as compressed adjacency lists: */
+    size_t *users, *usersStart; /* the nodes whose results depend on each node */
+    size_t *members, *membersStart; /* the values unified into each unification root */
+
+    /* Analysis: */
+    long *rangeMin, *rangeMax; /* bounds on the value of each integer node */
+
+    /* string operands, in node order */
+    struct SDyn_IRString *strs;
+    size_t strCount, strCapacity;
+
+    /* the control flow graph, derived once the IR is complete */
+    struct SDyn_CFG *cfg;
+
+    /* the types of the arguments this function is specialized for, or NULL */
+    const int *argTypes;
+
+    /* depth of inlined functions currently being compiled */
+    int inlining;
+
+    /* the source of the function being compiled, if it's bound to the global
+     * of its name, so recursive calls can be recognized. Else NULL. */
+    const unsigned char *selfSource;
+};
+
+/* compile a function to IR, specialized to the given argument types if
+ * argTypes isn't NULL */
+struct SDyn_IR *sdyn_irCompilePrime(struct SDyn_Arena *arena, struct SDyn_Node *func, const int *argTypes);
 
 /* perform register allocation on an IR */
-void sdyn_irRegAlloc(SDyn_IRNodeArray ir, struct SDyn_RegisterMap *registerMap);
+void sdyn_irRegAlloc(struct SDyn_IR *ir, struct SDyn_RegisterMap *registerMap);
+
+/* get the string operand of a node, or NULL if it has none */
+const unsigned char *sdyn_irString(struct SDyn_IR *ir, size_t node, size_t *strLen);
 
 /* compile and perform register allocation */
-SDyn_IRNodeArray sdyn_irCompile(SDyn_Node func, struct SDyn_RegisterMap *registerMap);
+struct SDyn_IR *sdyn_irCompile(struct SDyn_Arena *arena, struct SDyn_Node *func, const int *argTypes, struct SDyn_RegisterMap *registerMap);
 
 #endif
@@ -21,7 +21,21 @@
 
 #include "value.h"
 
-/* compile IR into a native function */
-sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir);
+/* compile IR into a native function. If fastEntry isn't NULL, it is set to
+ * the function's fast entry point, or NULL if it has none. If image isn't
+ * NULL, it is set to a malloc'd image of the function for sdyn_loadImage, and
+ * imageLen to its length, or NULL if it can't have one. */
+sdyn_native_function_t sdyn_compile(struct SDyn_IR *ir, void **fastEntry,
+        unsigned char **image, size_t *imageLen);
+
+/* load an image made by sdyn_compile, for the function with this source. The
+ * image must be word-aligned. Returns NULL if it's malformed. */
+sdyn_native_function_t sdyn_loadImage(const unsigned char *image, size_t len,
+        const unsigned char *source, void **fastEntry);
+
+/* images are only loaded by the same version of this, which identifies their
+ * format. The build of the JIT that made them must match too (see
+ * sdyn_buildStamp). */
+extern const char sdyn_imageVersion[];
 
 #endif
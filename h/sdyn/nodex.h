@@ -33,6 +33,8 @@ SDYN_NODEX(TOP)         /*  list                    global object   */
 SDYN_NODEX(GLOBALCALL)  /*  <id> []                 unused          */
 SDYN_NODEX(FUNDECL)     /*  <id> [Params, VarDecls, Statements]
                                                     unused          */
+SDYN_NODEX(LAZYFUNDECL) /*  <id> [Source]           unused          */
+SDYN_NODEX(SOURCE)      /*  <source text> []        unused          */
 SDYN_NODEX(VARDECLS)    /*  list                    unused          */
 SDYN_NODEX(VARDECL)     /*  <id> []                 unused          */
 SDYN_NODEX(PARAMS)      /*  list                    unused          */
@@ -137,3 +139,15 @@ SDYN_NODEX(ASSIGNMEMBER)    /* x.y=z
 SDYN_NODEX(ARG)             /* used implicitly by *CALL
                                i:argument number
                                l:value */
+
+/* guards inlined functions: is this value the function declared by this
+ * source? Evaluates to a bool. */
+SDYN_NODEX(CHECKFUNC)       /* i:source of the expected function (a pointer)
+                               s:name of the global it was found in
+                               l:value */
+
+/* a method call, obj.name(args), which looks the method up itself. Only used
+ * when evaluating the arguments can't change what the method is. */
+SDYN_NODEX(CALLMEMBER)      /* Args implicit
+                               s:method name
+                               l:object */
@@ -19,20 +19,35 @@
 #ifndef SDYN_PARSER_H
 #define SDYN_PARSER_H 1
 
-#include "ggggc/gc.h"
-
+#include "arena.h"
 #include "tokenizer.h"
 
-/* nodes are simply a type, optional token, and children */
-GGC_TYPE(SDyn_Node)
-    GGC_MDATA(int, type);
-    GGC_MDATA(struct SDyn_Token, tok);
-    GGC_MPTR(SDyn_NodeArray, children);
-GGC_END_TYPE(SDyn_Node,
-    GGC_PTR(SDyn_Node, children)
-    );
+/* nodes are simply a type, optional token, and children. They're allocated in
+ * an arena, and so only live as long as it takes to compile */
+struct SDyn_NodeArray;
+
+struct SDyn_Node {
+    int type;
+    struct SDyn_Token tok;
+    struct SDyn_NodeArray *children;
+};
+
+struct SDyn_NodeArray {
+    size_t length;
+    struct SDyn_Node *a[1];
+};
 
 /* the parser entry point */
-SDyn_Node sdyn_parse(const unsigned char *inp);
+struct SDyn_Node *sdyn_parse(struct SDyn_Arena *arena, const unsigned char *inp);
+
+/* the pre-parser entry point. Like sdyn_parse, but function bodies are only
+ * skipped, and functions are LAZYFUNDECL nodes recording their source */
+struct SDyn_Node *sdyn_preparse(struct SDyn_Arena *arena, const unsigned char *inp);
+
+/* parse a single function declaration, as found by the pre-parser */
+struct SDyn_Node *sdyn_parseFunction(struct SDyn_Arena *arena, const unsigned char *inp);
+
+/* like sdyn_parseFunction, but returns NULL on an error instead of aborting */
+struct SDyn_Node *sdyn_tryParseFunction(struct SDyn_Arena *arena, const unsigned char *inp);
 
 #endif
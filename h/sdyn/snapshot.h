@@ -0,0 +1,46 @@
+/*
+ * SDyn: Snapshot cache of compiled functions
+ *
+ * Copyright (c) 2015 Gregor Richards
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef SDYN_SNAPSHOT_H
+#define SDYN_SNAPSHOT_H 1
+
+#include "value.h"
+
+/* the environment variable naming the snapshot cache's directory. The cache is
+ * only used if it's set. */
+#define SDYN_SNAPSHOT_ENV "SDYN_CACHE"
+
+/* identifies this build of everything the compiled code depends on, generated
+ * at link time from a checksum of the objects (see the Makefile) */
+extern const char sdyn_buildStamp[];
+
+/* is the snapshot cache in use? */
+int sdyn_snapshotEnabled(void);
+
+/* load a function's code from the snapshot cache, by its source and the
+ * argument types it's specialized for (NULL for the generic version). Returns
+ * NULL if it isn't there. fastEntry is set as by sdyn_compile, and arity to
+ * the number of parameters, including "this", if they aren't NULL. */
+sdyn_native_function_t sdyn_snapshotLoad(const unsigned char *source, size_t sourceLen,
+        const int *argTypes, void **fastEntry, size_t *arity);
+
+/* store a function's image (see sdyn_compile) in the snapshot cache */
+void sdyn_snapshotStore(const unsigned char *source, size_t sourceLen,
+        const int *argTypes, size_t arity, const unsigned char *image, size_t imageLen);
+
+#endif
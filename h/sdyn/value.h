@@ -49,6 +49,9 @@ enum SDyn_DataType {
     SDYN_TYPE_LAST
 };
 
+/* is this a type of integers, boxed or not? */
+#define SDYN_TYPE_INTEGRAL(type) ((type) == SDYN_TYPE_INT || (type) == SDYN_TYPE_BOXED_INT)
+
 /* the type tag for boxed data types */
 GGC_TYPE(SDyn_Tag)
     GGC_MDATA(int, type);
@@ -68,11 +71,30 @@ GGC_TYPE(SDyn_Number)
     GGC_MDATA(long, value);
 GGC_END_TYPE(SDyn_Number, GGC_NO_PTRS);
 
-/* boxed strings */
+/* boxed strings. The hash is computed on demand, with 0 meaning "not yet
+ * computed". Interned strings are the unique string with their contents, so
+ * two interned strings are equal if and only if they're identical.
+ *
+ * Long concatenations are ropes: value is NULL, and the string is left+right,
+ * of total length length. Ropes are flattened (and left and right dropped)
+ * the first time their characters are needed, so always read the characters
+ * with sdyn_stringValue.
+ *
+ * If hasNumber is set, number is the string's value as converted by
+ * sdyn_toNumber. */
 GGC_TYPE(SDyn_String)
     GGC_MPTR(GGC_char_Array, value);
+    GGC_MPTR(SDyn_String, left);
+    GGC_MPTR(SDyn_String, right);
+    GGC_MDATA(size_t, length);
+    GGC_MDATA(size_t, hash);
+    GGC_MDATA(int, interned);
+    GGC_MDATA(long, number);
+    GGC_MDATA(int, hasNumber);
 GGC_END_TYPE(SDyn_String,
     GGC_PTR(SDyn_String, value)
+    GGC_PTR(SDyn_String, left)
+    GGC_PTR(SDyn_String, right)
     );
 
 /* object shape */
@@ -96,6 +118,9 @@ GGC_MAP(SDyn_ShapeMap, SDyn_String, SDyn_Shape, SDyn_ShapeMapStringHash, SDyn_Sh
 GGC_UNIT(size_t)
 GGC_MAP(SDyn_IndexMap, SDyn_String, GGC_size_t_Unit, SDyn_ShapeMapStringHash, SDyn_ShapeMapStringCmp);
 
+/* map of strings to their interned version */
+GGC_MAP(SDyn_InternMap, SDyn_String, SDyn_String, SDyn_ShapeMapStringHash, SDyn_ShapeMapStringCmp);
+
 /* object */
 GGC_TYPE(SDyn_Object)
     GGC_MPTR(SDyn_Shape, shape);
@@ -108,27 +133,76 @@ GGC_END_TYPE(SDyn_Object,
 /* function (compiled) */
 typedef SDyn_Undefined (*sdyn_native_function_t)(void **pstack, size_t argCt, SDyn_Undefined *args);
 
-/* function (data type) */
+/* a version of a function compiled for particular argument types. Like
+ * compiled code, these are never freed. */
+struct SDyn_Specialization {
+    unsigned long signature; /* the argument types, see sdyn_call */
+    sdyn_native_function_t value;
+    void *fast; /* fast entry point taking arguments in registers, or NULL */
+    size_t arity; /* number of parameters, including "this" */
+    struct SDyn_Specialization *next;
+};
+
+/* at most this many specializations are compiled per function, after which
+ * the generic version is used */
+#define SDYN_MAX_SPECIALIZATIONS 4
+
+/* functions with at most this many parameters (including "this") get fast
+ * entry points, and calls with at most this many arguments may use them */
+#define SDYN_FAST_ARGS 3
+
+/* a call site's cache of the fast entry point it last called */
+struct SDyn_CallCache {
+    const unsigned char *source; /* source of the cached function */
+    void *fast;
+};
+
+/* a method call site's cache: where the method was in the last receiver's
+ * shape, and the method itself. The name and shape are GC roots. */
+struct SDyn_MethodCache {
+    SDyn_String *member;
+    SDyn_Shape *shape;
+    size_t index;
+    struct SDyn_CallCache call;
+};
+
+/* a member assignment site's cache: where the member was in the last
+ * object's shape. The name and shape are GC roots. */
+struct SDyn_MemberCache {
+    SDyn_String *member;
+    SDyn_Shape *shape;
+    size_t index;
+};
+
+/* function (data type). Functions keep only the range of source text declaring
+ * them; they're parsed and compiled in a scratch arena when first called */
 GGC_TYPE(SDyn_Function)
-    GGC_MPTR(SDyn_Node, ast);
-    GGC_MPTR(SDyn_IRNodeArray, irValue);
     GGC_MDATA(sdyn_native_function_t, value);
-GGC_END_TYPE(SDyn_Function,
-    GGC_PTR(SDyn_Function, ast)
-    GGC_PTR(SDyn_Function, irValue)
-    );
-
-/* important global values */
-extern SDyn_Undefined sdyn_undefined;
-extern SDyn_Boolean sdyn_false, sdyn_true;
+    GGC_MDATA(struct SDyn_Specialization *, specializations);
+    GGC_MDATA(size_t, specializationCount);
+    GGC_MDATA(const unsigned char *, source);
+    GGC_MDATA(size_t, sourceLen);
+GGC_END_TYPE(SDyn_Function, GGC_NO_PTRS);
+
+/* important global values. Those JIT code uses often are kept together, so
+ * it can reach them all from one pinned register */
+struct SDyn_Globals {
+    SDyn_Undefined undefined;
+    SDyn_Boolean falseValue, trueValue;
+    SDyn_Object globalObject;
+};
+extern struct SDyn_Globals sdyn_globals;
+#define sdyn_undefined      (sdyn_globals.undefined)
+#define sdyn_false          (sdyn_globals.falseValue)
+#define sdyn_true           (sdyn_globals.trueValue)
+#define sdyn_globalObject   (sdyn_globals.globalObject)
 extern SDyn_Shape sdyn_emptyShape;
-extern SDyn_Object sdyn_globalObject;
 
 /* our global value initializer */
 void sdyn_initValues(void);
 
-/* simple boxer for functions */
-SDyn_Function sdyn_boxFunction(SDyn_Node ast);
+/* simple boxer for functions, from a LAZYFUNDECL */
+SDyn_Function sdyn_boxFunction(struct SDyn_Node *decl);
 
 /* the remaining functions are intended to be called by the JIT */
 
@@ -144,9 +218,21 @@ SDyn_Number sdyn_boxInt(void **pstack, long value);
 /* simple boxer for strings */
 SDyn_String sdyn_boxString(void **pstack, char *value, size_t len);
 
+/* get the characters of a string, flattening it if it's a rope */
+GGC_char_Array sdyn_stringValue(void **pstack, SDyn_String str);
+
+/* get the length of a string without flattening it */
+size_t sdyn_stringLength(SDyn_String str);
+
 /* and a specialized boxer for quoted strings */
 SDyn_String sdyn_unquote(SDyn_String istr);
 
+/* get the interned version of a string */
+SDyn_String sdyn_intern(void **pstack, SDyn_String str);
+
+/* box and intern a string */
+SDyn_String sdyn_internString(void **pstack, char *value, size_t len);
+
 /* type coercions */
 int sdyn_toBoolean(void **pstack, SDyn_Undefined value);
 long sdyn_toNumber(void **pstack, SDyn_Undefined value);
@@ -154,6 +240,9 @@ SDyn_String sdyn_toString(void **pstack, SDyn_Undefined value);
 SDyn_Object sdyn_toObject(void **pstack, SDyn_Undefined value);
 SDyn_Undefined sdyn_toValue(void **pstack, SDyn_Undefined value);
 
+/* convert an integer to a string, sharing the strings for small integers */
+SDyn_String sdyn_intToString(void **pstack, long value);
+
 /* assertions */
 SDyn_Function sdyn_assertFunction(void **pstack, SDyn_Function func);
 
@@ -169,6 +258,9 @@ SDyn_Undefined sdyn_getObjectMember(void **pstack, SDyn_Object object, SDyn_Stri
 /* set or add a member on/to an object */
 void sdyn_setObjectMember(void **pstack, SDyn_Object object, SDyn_String member, SDyn_Undefined value);
 
+/* set a member of an object by name, filling a member cache */
+void sdyn_setObjectMemberCached(void **pstack, SDyn_Object object, SDyn_Undefined value, struct SDyn_MemberCache *cache);
+
 /* the ever-complicated add function */
 SDyn_Undefined sdyn_add(void **pstack, SDyn_Undefined left, SDyn_Undefined right);
 
@@ -178,7 +270,16 @@ int sdyn_equal(void **pstack, SDyn_Undefined left, SDyn_Undefined right);
 /* assert that a function is compiled */
 sdyn_native_function_t sdyn_assertCompiled(void **pstack, SDyn_Function func);
 
+/* assert that a function is compiled, specialized to these arguments if possible */
+sdyn_native_function_t sdyn_assertSpecialized(void **pstack, SDyn_Function func, size_t argCt, SDyn_Undefined *args);
+
 /* call a function, with JIT compilation */
 SDyn_Undefined sdyn_call(void **pstack, SDyn_Function func, size_t argCt, SDyn_Undefined *args);
 
+/* call a function from a call site with a call cache */
+SDyn_Undefined sdyn_callCached(void **pstack, SDyn_Function func, size_t argCt, SDyn_Undefined *args, struct SDyn_CallCache *cache);
+
+/* call a method from a call site with a method cache */
+SDyn_Undefined sdyn_callMethod(void **pstack, SDyn_Undefined object, size_t argCt, SDyn_Undefined *args, struct SDyn_MethodCache *cache);
+
 #endif
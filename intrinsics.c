@@ -31,7 +31,7 @@ sdyn_native_function_t sdyn_getIntrinsic(SDyn_String intrinsic)
 
     GGC_PUSH_2(intrinsic, schar);
 
-    schar = GGC_RP(intrinsic, value);
+    schar = sdyn_stringValue(NULL, intrinsic);
 
 #define TOK(str) if (!strncmp(schar->a__data, "$" #str, schar->length))
 
@@ -61,7 +61,7 @@ SDyn_Undefined sdyn_iEval(void **pstack, size_t argCt, SDyn_Undefined *args)
     else codeStr = sdyn_boxString(NULL, "", 0);
 
     /* get it out of the GC */
-    codeA = GGC_RP(codeStr, value);
+    codeA = sdyn_stringValue(NULL, codeStr);
     code = malloc(codeA->length + 1);
     if (!code) {
         perror("malloc");
@@ -89,7 +89,7 @@ SDyn_Undefined sdyn_iPrint(void **pstack, size_t argCt, SDyn_Undefined *args)
     if (argCt < 1) return sdyn_undefined;
 
     string = sdyn_toString(NULL, args[0]);
-    schar = GGC_RP(string, value);
+    schar = sdyn_stringValue(NULL, string);
     printf("%.*s\n", (int) schar->length, schar->a__data);
 
     return sdyn_undefined;
@@ -42,119 +42,415 @@
  * variable.
  */
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 
-#include "ggggc/gc.h"
-#include "ggggc/collections/list.h"
-
 #include "sdyn/ir.h"
 #include "sdyn/value.h"
 
-GGC_LIST(SDyn_IRNode)
+/* symbol tables map local variable names (as source text) to the IR index of
+ * their current value */
+struct SymbolEntry {
+    const unsigned char *name;
+    size_t nameLen;
+    size_t idx;
+};
 
-/* utility function to clone a symbol table */
-static SDyn_IndexMap cloneSymbolTable(SDyn_IndexMap symbols)
+struct SymbolTable {
+    size_t size, count;
+    struct SymbolEntry *entries;
+};
+
+static size_t symbolHash(const unsigned char *name, size_t nameLen)
 {
-    SDyn_IndexMap symbols2 = NULL;
-    SDyn_String name = NULL;
-    GGC_size_t_Unit indexBox = NULL;
-    size_t i;
+    size_t i, ret = 0;
+    for (i = 0; i < nameLen; i++)
+        ret = name[i] + (ret << 16) - ret;
+    return ret;
+}
+
+/* find the entry for this name, or the empty entry where it belongs */
+static struct SymbolEntry *symbolFind(struct SymbolTable *symbols, const unsigned char *name, size_t nameLen)
+{
+    size_t i = symbolHash(name, nameLen) & (symbols->size - 1);
+    struct SymbolEntry *entry;
+
+    while (1) {
+        entry = &symbols->entries[i];
+        if (!entry->name ||
+            (entry->nameLen == nameLen && !memcmp(entry->name, name, nameLen)))
+            return entry;
+        i = (i + 1) & (symbols->size - 1);
+    }
+}
+
+static struct SymbolTable *newSymbolTable(struct SDyn_Arena *arena)
+{
+    struct SymbolTable *ret = sdyn_arenaAlloc(arena, sizeof(struct SymbolTable));
+    ret->size = 16;
+    ret->entries = sdyn_arenaAlloc(arena, ret->size * sizeof(struct SymbolEntry));
+    return ret;
+}
+
+static int symbolGet(struct SymbolTable *symbols, const unsigned char *name, size_t nameLen, size_t *idx)
+{
+    struct SymbolEntry *entry = symbolFind(symbols, name, nameLen);
+    if (!entry->name) return 0;
+    *idx = entry->idx;
+    return 1;
+}
+
+static void symbolPut(struct SDyn_Arena *arena, struct SymbolTable *symbols, const unsigned char *name, size_t nameLen, size_t idx)
+{
+    struct SymbolEntry *entry;
+
+    /* keep the table at most half full */
+    if ((symbols->count + 1) * 2 > symbols->size) {
+        struct SymbolEntry *oldEntries = symbols->entries;
+        size_t i, oldSize = symbols->size;
+
+        symbols->size *= 2;
+        symbols->entries = sdyn_arenaAlloc(arena, symbols->size * sizeof(struct SymbolEntry));
+        for (i = 0; i < oldSize; i++) {
+            if (oldEntries[i].name)
+                *symbolFind(symbols, oldEntries[i].name, oldEntries[i].nameLen) = oldEntries[i];
+        }
+    }
+
+    entry = symbolFind(symbols, name, nameLen);
+    if (!entry->name) {
+        entry->name = name;
+        entry->nameLen = nameLen;
+        symbols->count++;
+    }
+    entry->idx = idx;
+}
 
-    GGC_PUSH_4(symbols, symbols2, name, indexBox);
+/* utility function to clone a symbol table */
+static struct SymbolTable *cloneSymbolTable(struct SDyn_Arena *arena, struct SymbolTable *symbols)
+{
+    struct SymbolTable *symbols2;
 
     /* we'll need to compare our symbol table before and after to unify, so first, copy */
-    symbols2 = SDyn_IndexMapClone(symbols);
+    symbols2 = sdyn_arenaAlloc(arena, sizeof(struct SymbolTable));
+    *symbols2 = *symbols;
+    symbols2->entries = sdyn_arenaAlloc(arena, symbols->size * sizeof(struct SymbolEntry));
+    memcpy(symbols2->entries, symbols->entries, symbols->size * sizeof(struct SymbolEntry));
 
     return symbols2;
 }
 
-/* utility function to unify symbol tables */
-static void unifySymbolTables(SDyn_IRNodeList ir, SDyn_IndexMap symbols, SDyn_IndexMap symbols2, int loop)
+/* grow one of the IR's parallel arrays */
+#define IR_GROW(field) do { \
+    ir->field = sdyn_arenaRealloc(ir->arena, ir->field, \
+        ir->capacity * sizeof(*ir->field), \
+        capacity * sizeof(*ir->field)); \
+} while(0)
+
+/* add a node to the IR, returning its index */
+static size_t irPush(struct SDyn_IR *ir, struct SDyn_IRNode *node)
 {
-    SDyn_IndexMapEntry entry = NULL;
-    SDyn_IRNode irn = NULL;
-    SDyn_String name = NULL;
-    GGC_size_t_Unit indexBox = NULL, indexBox2 = NULL;
-    size_t i;
+    size_t idx;
+
+    if (ir->length >= ir->capacity) {
+        size_t capacity = ir->capacity ? ir->capacity * 2 : 64;
+        IR_GROW(op);
+        IR_GROW(rtype);
+        IR_GROW(imm);
+        IR_GROW(left);
+        IR_GROW(right);
+        IR_GROW(third);
+        IR_GROW(stype);
+        IR_GROW(addr);
+        IR_GROW(uidx);
+        ir->capacity = capacity;
+    }
 
-    GGC_PUSH_8(ir, symbols, symbols2, entry, irn, name, indexBox, indexBox2);
+    idx = ir->length++;
+    ir->op[idx] = node->op;
+    ir->rtype[idx] = node->rtype;
+    ir->imm[idx] = node->imm;
+    ir->left[idx] = node->left;
+    ir->right[idx] = node->right;
+    ir->third[idx] = node->third;
+
+    /* strings go in the side table */
+    if (node->str) {
+        struct SDyn_IRString *str;
+        if (ir->strCount >= ir->strCapacity) {
+            size_t capacity = ir->strCapacity ? ir->strCapacity * 2 : 16;
+            ir->strs = sdyn_arenaRealloc(ir->arena, ir->strs,
+                ir->strCapacity * sizeof(struct SDyn_IRString),
+                capacity * sizeof(struct SDyn_IRString));
+            ir->strCapacity = capacity;
+        }
+        str = &ir->strs[ir->strCount++];
+        str->node = idx;
+        str->str = node->str;
+        str->strLen = node->strLen;
+    }
 
-    /* go through each symbol */
-    for (i = 0; i < GGC_RD(symbols2, size); i++) {
-        entry = GGC_RAP(GGC_RP(symbols2, entries), i);
-        while (entry) {
-            size_t idx;
-            name = GGC_RP(entry, key);
-            indexBox2 = GGC_RP(entry, value);
-            idx = GGC_RD(indexBox2, v);
-            if (SDyn_IndexMapGet(symbols, name, &indexBox)) {
-                if (indexBox != indexBox2) {
-                    size_t idx;
-
-                    /* they both have different indexes, must unify */
-                    irn = GGC_NEW(SDyn_IRNode);
-                    GGC_WD(irn, op, SDYN_NODE_UNIFY);
-                    GGC_WD(irn, rtype, SDYN_TYPE_BOXED);
-                    idx = GGC_RD(indexBox, v);
-                    GGC_WD(irn, left, idx);
-                    idx = GGC_RD(indexBox2, v);
-                    GGC_WD(irn, right, idx);
-                    indexBox = GGC_NEW(GGC_size_t_Unit);
-                    idx = GGC_RD(ir, length);
-                    GGC_WD(indexBox, v, idx);
-                    SDyn_IRNodeListPush(ir, irn);
-                }
+    return idx;
+}
 
-            } else {
-                /* added in symbols2, just need to copy it */
-                SDyn_IndexMapPut(symbols, name, indexBox2);
+#undef IR_GROW
 
-            }
+/* get the string operand of a node, or NULL if it has none */
+const unsigned char *sdyn_irString(struct SDyn_IR *ir, size_t node, size_t *strLen)
+{
+    size_t lo = 0, hi = ir->strCount, mid;
+
+    /* the side table is in node order, so binary search it */
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (ir->strs[mid].node < node)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
 
-            /* NOP it so it stays alive for loops */
-            if (loop) {
-                irn = GGC_NEW(SDyn_IRNode);
-                GGC_WD(irn, op, SDYN_NODE_NOP);
-                GGC_WD(irn, left, idx);
-                SDyn_IRNodeListPush(ir, irn);
+    if (lo < ir->strCount && ir->strs[lo].node == node) {
+        *strLen = ir->strs[lo].strLen;
+        return ir->strs[lo].str;
+    }
+
+    *strLen = 0;
+    return NULL;
+}
+
+/* an empty IR node, to start new nodes from */
+static const struct SDyn_IRNode irNodeZero;
+
+/* utility function to unify symbol tables */
+static void unifySymbolTables(struct SDyn_IR *ir, struct SymbolTable *symbols, struct SymbolTable *symbols2, int loop)
+{
+    struct SymbolEntry *entry;
+    struct SDyn_IRNode irn;
+    size_t i;
+
+    /* go through each symbol */
+    for (i = 0; i < symbols2->size; i++) {
+        size_t idx, idx2;
+        entry = &symbols2->entries[i];
+        if (!entry->name) continue;
+
+        idx2 = entry->idx;
+        if (symbolGet(symbols, entry->name, entry->nameLen, &idx)) {
+            if (idx != idx2) {
+                /* they both have different indexes, must unify */
+                irn = irNodeZero;
+                irn.op = SDYN_NODE_UNIFY;
+                irn.rtype = SDYN_TYPE_BOXED;
+                irn.left = idx;
+                irn.right = idx2;
+                irPush(ir, &irn);
             }
 
-            entry = GGC_RP(entry, next);
+        } else {
+            /* added in symbols2, just need to copy it */
+            symbolPut(ir->arena, symbols, entry->name, entry->nameLen, idx2);
+
+        }
+
+        /* NOP it so it stays alive for loops */
+        if (loop) {
+            irn = irNodeZero;
+            irn.op = SDYN_NODE_NOP;
+            irn.left = idx2;
+            irPush(ir, &irn);
         }
     }
 
     return;
 }
 
-/* compile a parse tree node to IR */
-static size_t irCompileNode(SDyn_IRNodeList ir, SDyn_Node node, SDyn_IndexMap symbols, size_t *target)
+/* functions with bodies no larger than this many parse nodes are inlined */
+#define INLINE_MAX_NODES 32
+
+/* functions with more source than this aren't even parsed to count their
+ * nodes, since they're very unlikely to be small enough */
+#define INLINE_MAX_SOURCE 1024
+
+/* count the parse nodes in a function body, failing (returning a count too
+ * large to inline) if it has a return anywhere but as its last statement */
+static size_t inlineSize(struct SDyn_Node *node, int lastStatement)
+{
+    size_t ret, i;
+
+    if (node->type == SDYN_NODE_RETURN && !lastStatement)
+        return INLINE_MAX_NODES + 1;
+
+    ret = 1;
+    if (node->children) {
+        for (i = 0; i < node->children->length && ret <= INLINE_MAX_NODES; i++)
+            ret += inlineSize(node->children->a[i], 0);
+    }
+    return ret;
+}
+
+/* find the source of the function currently bound to this global, or NULL if
+ * it isn't a function or there's no global object to look in (i.e., when just
+ * testing the IR) */
+static const unsigned char *globalSource(struct SDyn_Token *tok, size_t *sourceLen)
 {
-    SDyn_NodeArray children = NULL;
-    SDyn_Node cnode = NULL;
-    SDyn_IRNode irn = NULL;
     SDyn_String name = NULL;
-    GGC_size_t_Unit indexBox = NULL, indexBox2 = NULL;
-    GGC_size_t_Array args = NULL;
-    SDyn_IndexMap symbols2 = NULL;
+    SDyn_Undefined value = NULL;
+    SDyn_Tag tag = NULL;
 
-    struct SDyn_Token tok;
+    if (!sdyn_globalObject) return NULL;
+
+    GGC_PUSH_3(name, value, tag);
+
+    name = sdyn_internString(NULL, (char *) tok->val, tok->valLen);
+    value = sdyn_getObjectMember(NULL, sdyn_globalObject, name);
+    tag = (SDyn_Tag) GGC_RUP(value);
+    if (GGC_RD(tag, type) != SDYN_TYPE_FUNCTION) return NULL;
+    if (sourceLen) *sourceLen = GGC_RD((SDyn_Function) value, sourceLen);
+    return GGC_RD((SDyn_Function) value, source);
+}
+
+/* find the function currently bound to this global, if it's small enough to
+ * inline. Returns its parse tree and source, or NULL if it isn't inlinable. */
+static struct SDyn_Node *inlineCandidate(struct SDyn_IR *ir, struct SDyn_Token *tok, const unsigned char **source)
+{
+    struct SDyn_Node *decl, *statements;
+    size_t sourceLen, size, i;
+
+    /* don't inline into inlined code, or ourself */
+    if (ir->inlining) return NULL;
+    *source = globalSource(tok, &sourceLen);
+    if (!*source || *source == ir->selfSource) return NULL;
+
+    /* don't parse large functions just to find that out */
+    if (sourceLen > INLINE_MAX_SOURCE) return NULL;
+
+    /* parse it and see if it's small enough. If it doesn't parse, leave the
+     * error to be reported when it's actually called. */
+    decl = sdyn_tryParseFunction(ir->arena, *source);
+    if (!decl) return NULL;
+    statements = decl->children->a[2];
+    size = 1;
+    for (i = 0; i < statements->children->length && size <= INLINE_MAX_NODES; i++)
+        size += inlineSize(statements->children->a[i], i == statements->children->length - 1);
+    if (size > INLINE_MAX_NODES) return NULL;
+
+    return decl;
+}
+
+static size_t irCompileNode(struct SDyn_IR *ir, struct SDyn_Node *node, struct SymbolTable *symbols, size_t *target);
+
+/* can evaluating this expression have side effects? Assignments obviously
+ * can, and calls can do anything */
+static int hasEffects(struct SDyn_Node *node)
+{
     size_t i;
 
-    GGC_PUSH_11(ir, node, symbols, children, cnode, irn, name, indexBox, indexBox2, args, symbols2);
+    switch (node->type) {
+        case SDYN_NODE_ASSIGN:
+        case SDYN_NODE_CALL:
+        case SDYN_NODE_INTRINSICCALL:
+            return 1;
+    }
+
+    if (node->children) {
+        for (i = 0; i < node->children->length; i++)
+            if (hasEffects(node->children->a[i])) return 1;
+    }
+    return 0;
+}
+
+/* compile the body of a function inline. Copies of the call's arguments are
+ * bound to the parameters, and the value of the final return statement (if
+ * any) is the result. */
+static size_t irCompileInline(struct SDyn_IR *ir, struct SDyn_Node *decl, size_t *args, size_t argCt)
+{
+    struct SymbolTable *symbols;
+    struct SDyn_Node *params, *statements, *cnode;
+    struct SDyn_IRNode irn;
+    struct SDyn_Token tok;
+    size_t i, val, ret;
+
+    ir->inlining++;
+    symbols = newSymbolTable(ir->arena);
+
+    /* bind the arguments, with undefined for any missing */
+    symbolPut(ir->arena, symbols, (const unsigned char *) "this", 4, args[0]);
+    params = decl->children->a[0];
+    for (i = 0; i < params->children->length; i++) {
+        if (i + 1 < argCt) {
+            /* copied, as assignment to a local would, so that assigning the
+             * parameter can't clobber the caller's variable */
+            irn = irNodeZero;
+            irn.op = SDYN_NODE_ASSIGN;
+            irn.rtype = SDYN_TYPE_BOXED;
+            irn.left = args[i + 1];
+            val = irPush(ir, &irn);
+        } else {
+            irn = irNodeZero;
+            irn.op = SDYN_NODE_NIL;
+            irn.rtype = SDYN_TYPE_UNDEFINED;
+            val = irPush(ir, &irn);
+        }
+        tok = params->children->a[i]->tok;
+        symbolPut(ir->arena, symbols, tok.val, tok.valLen, val);
+    }
+
+    /* then the body */
+    irCompileNode(ir, decl->children->a[1], symbols, NULL);
+    statements = decl->children->a[2];
+    ret = 0;
+    for (i = 0; i < statements->children->length; i++) {
+        cnode = statements->children->a[i];
+        if (cnode->type == SDYN_NODE_RETURN) {
+            /* only the last statement may return */
+            ret = irCompileNode(ir, cnode->children->a[0], symbols, NULL);
+        } else {
+            irCompileNode(ir, cnode, symbols, NULL);
+        }
+    }
+    if (!ret) {
+        irn = irNodeZero;
+        irn.op = SDYN_NODE_NIL;
+        irn.rtype = SDYN_TYPE_UNDEFINED;
+        ret = irPush(ir, &irn);
+    }
+
+    /* the result will be unified with the call's, so give it its own node */
+    irn = irNodeZero;
+    irn.op = SDYN_NODE_ASSIGN;
+    irn.rtype = SDYN_TYPE_BOXED;
+    irn.left = ret;
+    ret = irPush(ir, &irn);
 
-    children = GGC_RP(node, children);
+    ir->inlining--;
+    return ret;
+}
 
-#define SUB(x) irCompileNode(ir, GGC_RAP(children, x), symbols, NULL)
+/* compile a parse tree node to IR */
+static size_t irCompileNode(struct SDyn_IR *ir, struct SDyn_Node *node, struct SymbolTable *symbols, size_t *target)
+{
+    struct SDyn_NodeArray *children;
+    struct SDyn_Node *cnode;
+    struct SDyn_IRNode irn;
+    struct SymbolTable *symbols2;
+    size_t *args;
+    size_t argCt;
+
+    struct SDyn_Token tok;
+    size_t i;
+
+    children = node->children;
+
+#define SUB(x) irCompileNode(ir, children->a[x], symbols, NULL)
 #define IRNNEW() do { \
-    int irntype; \
-    irn = GGC_NEW(SDyn_IRNode); \
-    irntype = GGC_RD(node, type); \
-    GGC_WD(irn, op, irntype); \
+    irn = irNodeZero; \
+    irn.op = node->type; \
 } while(0)
 
-    switch (GGC_RD(node, type)) {
+    switch (node->type) {
         case SDYN_NODE_TOP:
         case SDYN_NODE_GLOBALCALL:
             /* only for debugging purposes */
@@ -171,265 +467,243 @@ static size_t irCompileNode(SDyn_IRNodeList ir, SDyn_Node node, SDyn_IndexMap sy
             break;
 
         case SDYN_NODE_FUNDECL:
-            /* our top level */
+            /* our top level. If the global of our name is bound to this very
+             * declaration, calls to it are recursive */
+            {
+                const unsigned char *source;
+                size_t sourceLen;
+                tok = node->tok;
+                source = globalSource(&tok, &sourceLen);
+                if (source && tok.val >= source && tok.val < source + sourceLen)
+                    ir->selfSource = source;
+            }
+
             /* make space for locals */
-            irn = GGC_NEW(SDyn_IRNode);
-            GGC_WD(irn, op, SDYN_NODE_ALLOCA);
-            SDyn_IRNodeListPush(ir, irn);
-            irn = GGC_NEW(SDyn_IRNode);
-            GGC_WD(irn, op, SDYN_NODE_PALLOCA);
-            SDyn_IRNodeListPush(ir, irn);
+            irn = irNodeZero;
+            irn.op = SDYN_NODE_ALLOCA;
+            irPush(ir, &irn);
+            irn = irNodeZero;
+            irn.op = SDYN_NODE_PALLOCA;
+            irPush(ir, &irn);
 
             SUB(0); /* params */
             SUB(1); /* vardecls */
             SUB(2); /* statements */
 
             /* return undefined */
-            irn = GGC_NEW(SDyn_IRNode);
-            GGC_WD(irn, op, SDYN_NODE_NIL);
-            GGC_WD(irn, rtype, SDYN_TYPE_UNDEFINED);
-            i = GGC_RD(ir, length);
-            SDyn_IRNodeListPush(ir, irn);
-            irn = GGC_NEW(SDyn_IRNode);
-            GGC_WD(irn, op, SDYN_NODE_RETURN);
-            GGC_WD(irn, left, i);
-            SDyn_IRNodeListPush(ir, irn);
+            irn = irNodeZero;
+            irn.op = SDYN_NODE_NIL;
+            irn.rtype = SDYN_TYPE_UNDEFINED;
+            i = irPush(ir, &irn);
+            irn = irNodeZero;
+            irn.op = SDYN_NODE_RETURN;
+            irn.left = i;
+            irPush(ir, &irn);
 
             /* pop our space */
-            irn = GGC_NEW(SDyn_IRNode);
-            GGC_WD(irn, op, SDYN_NODE_PPOPA);
-            SDyn_IRNodeListPush(ir, irn);
-            irn = GGC_NEW(SDyn_IRNode);
-            GGC_WD(irn, op, SDYN_NODE_POPA);
-            SDyn_IRNodeListPush(ir, irn);
+            irn = irNodeZero;
+            irn.op = SDYN_NODE_PPOPA;
+            irPush(ir, &irn);
+            irn = irNodeZero;
+            irn.op = SDYN_NODE_POPA;
+            irPush(ir, &irn);
             break;
 
         case SDYN_NODE_PARAMS:
-            /* first the "this" parameter */
-            name = sdyn_boxString(NULL, "this", 4);
-
-            /* add it to the symbol table */
-            indexBox = GGC_NEW(GGC_size_t_Unit);
-            i = GGC_RD(ir, length);
-            GGC_WD(indexBox, v, i);
-            SDyn_IndexMapPut(symbols, name, indexBox);
+            /* first the "this" parameter, added to the symbol table */
+            symbolPut(ir->arena, symbols, (const unsigned char *) "this", 4, ir->length);
 
             /* make the IR node */
-            irn = GGC_NEW(SDyn_IRNode);
-            GGC_WD(irn, op, SDYN_NODE_PARAM);
-            GGC_WD(irn, rtype, SDYN_TYPE_BOXED);
-            GGC_WD(irn, imm, 0);
-            SDyn_IRNodeListPush(ir, irn);
+            irn = irNodeZero;
+            irn.op = SDYN_NODE_PARAM;
+            irn.rtype = ir->argTypes ? ir->argTypes[0] : SDYN_TYPE_BOXED;
+            irn.imm = 0;
+            irPush(ir, &irn);
 
             /* now the normal parameters */
             for (i = 0; i < children->length; i++) {
-                size_t paramIdx, paramNum;
-
-                cnode = GGC_RAP(children, i);
-
-                tok = GGC_RD(cnode, tok);
-                name = sdyn_boxString(NULL, (char *) tok.val, tok.valLen);
+                cnode = children->a[i];
 
                 /* add it to the symbol table */
-                indexBox = GGC_NEW(GGC_size_t_Unit);
-                paramIdx = GGC_RD(ir, length);
-                GGC_WD(indexBox, v, paramIdx);
-                SDyn_IndexMapPut(symbols, name, indexBox);
+                tok = cnode->tok;
+                symbolPut(ir->arena, symbols, tok.val, tok.valLen, ir->length);
 
                 /* make the IR node */
-                irn = GGC_NEW(SDyn_IRNode);
-                GGC_WD(irn, op, SDYN_NODE_PARAM);
-                GGC_WD(irn, rtype, SDYN_TYPE_BOXED);
-                paramNum = i + 1;
-                GGC_WD(irn, imm, paramNum);
+                irn = irNodeZero;
+                irn.op = SDYN_NODE_PARAM;
+                irn.rtype = SDYN_TYPE_BOXED;
+                irn.imm = i + 1;
+                if (ir->argTypes && i + 1 < SDYN_SPECIALIZE_ARGS)
+                    irn.rtype = ir->argTypes[i + 1];
 
                 /* add it to the list */
-                SDyn_IRNodeListPush(ir, irn);
+                irPush(ir, &irn);
             }
             break;
 
         case SDYN_NODE_VARDECL:
-            tok = GGC_RD(node, tok);
-            name = sdyn_boxString(NULL, (char *) tok.val, tok.valLen);
-
             /* add it to the symbol table */
-            indexBox = GGC_NEW(GGC_size_t_Unit);
-            i = GGC_RD(ir, length);
-            GGC_WD(indexBox, v, i);
-            SDyn_IndexMapPut(symbols, name, indexBox);
+            tok = node->tok;
+            symbolPut(ir->arena, symbols, tok.val, tok.valLen, ir->length);
 
             /* and make an IR node */
-            irn = GGC_NEW(SDyn_IRNode);
-            GGC_WD(irn, op, SDYN_NODE_NIL);
-            GGC_WD(irn, rtype, SDYN_TYPE_UNDEFINED);
+            irn = irNodeZero;
+            irn.op = SDYN_NODE_NIL;
+            irn.rtype = SDYN_TYPE_UNDEFINED;
 
             /* add it to the list */
-            SDyn_IRNodeListPush(ir, irn);
+            irPush(ir, &irn);
             break;
 
         case SDYN_NODE_ASSIGN:
             /* what we do from here depends on the type of the LHS */
-            cnode = GGC_RAP(children, 0);
-            switch (GGC_RD(cnode, type)) {
+            cnode = children->a[0];
+            switch (cnode->type) {
                 case SDYN_NODE_INDEX:
-                    irn = GGC_NEW(SDyn_IRNode);
-                    GGC_WD(irn, op, SDYN_NODE_ASSIGNINDEX);
-                    GGC_WD(irn, rtype, SDYN_TYPE_BOXED);
+                    irn = irNodeZero;
+                    irn.op = SDYN_NODE_ASSIGNINDEX;
+                    irn.rtype = SDYN_TYPE_BOXED;
 
                     /* get the indexed object */
-                    children = GGC_RP(cnode, children);
-                    i = SUB(0);
-                    GGC_WD(irn, left, i);
+                    children = cnode->children;
+                    irn.left = SUB(0);
 
                     /* get the index itself */
-                    i = SUB(1);
-                    GGC_WD(irn, right, i);
-                    children = GGC_RP(node, children);
+                    irn.right = SUB(1);
+                    children = node->children;
 
                     /* get the value */
-                    i = SUB(1);
-                    GGC_WD(irn, third, i);
+                    irn.third = SUB(1);
 
                     /* and perform the assignment */
-                    SDyn_IRNodeListPush(ir, irn);
+                    irPush(ir, &irn);
 
                     break;
 
                 case SDYN_NODE_MEMBER:
-                    irn = GGC_NEW(SDyn_IRNode);
-                    GGC_WD(irn, op, SDYN_NODE_ASSIGNMEMBER);
-                    GGC_WD(irn, rtype, SDYN_TYPE_BOXED);
+                    irn = irNodeZero;
+                    irn.op = SDYN_NODE_ASSIGNMEMBER;
+                    irn.rtype = SDYN_TYPE_BOXED;
 
                     /* get the object */
-                    children = GGC_RP(cnode, children);
-                    i = SUB(0);
-                    GGC_WD(irn, left, i);
-                    children = GGC_RP(node, children);
+                    children = cnode->children;
+                    irn.left = SUB(0);
+                    children = node->children;
 
                     /* the name is the token */
-                    tok = GGC_RD(cnode, tok);
-                    name = sdyn_boxString(NULL, (char *) tok.val, tok.valLen);
-                    GGC_WP(irn, immp, name);
+                    tok = cnode->tok;
+                    irn.str = tok.val;
+                    irn.strLen = tok.valLen;
 
                     /* get the value */
-                    i = SUB(1);
-                    GGC_WD(irn, right, i);
+                    irn.right = SUB(1);
 
                     /* and perform the assignment */
-                    SDyn_IRNodeListPush(ir, irn);
+                    irPush(ir, &irn);
 
                     break;
 
                 case SDYN_NODE_VARREF:
                 {
-                    size_t val;
+                    size_t val, idx;
 
                     /* get the value */
                     val = SUB(1);
 
                     /* the variable being accessed */
-                    tok = GGC_RD(cnode, tok);
-                    name = sdyn_boxString(NULL, (char *) tok.val, tok.valLen);
+                    tok = cnode->tok;
 
                     /* check if it's in the symbol table */
-                    if (SDyn_IndexMapGet(symbols, name, &indexBox)) {
+                    if (symbolGet(symbols, tok.val, tok.valLen, &idx)) {
                         /* local variable reference */
                         IRNNEW();
-                        GGC_WD(irn, rtype, SDYN_TYPE_BOXED);
-                        GGC_WD(irn, left, val);
-                        val = GGC_RD(ir, length);
-                        SDyn_IRNodeListPush(ir, irn);
+                        irn.rtype = SDYN_TYPE_BOXED;
+                        irn.left = val;
+                        val = irPush(ir, &irn);
 
                         /* update the symbol table */
-                        indexBox = GGC_NEW(GGC_size_t_Unit);
-                        GGC_WD(indexBox, v, val);
-                        SDyn_IndexMapPut(symbols, name, indexBox);
+                        symbolPut(ir->arena, symbols, tok.val, tok.valLen, val);
 
                     } else {
                         /* global variable reference, perform as assignment on global object */
                         size_t g;
 
                         /* get the global object */
-                        irn = GGC_NEW(SDyn_IRNode);
-                        GGC_WD(irn, op, SDYN_NODE_TOP);
-                        GGC_WD(irn, rtype, SDYN_TYPE_OBJECT);
-                        g = GGC_RD(ir, length);
-                        SDyn_IRNodeListPush(ir, irn);
+                        irn = irNodeZero;
+                        irn.op = SDYN_NODE_TOP;
+                        irn.rtype = SDYN_TYPE_OBJECT;
+                        g = irPush(ir, &irn);
 
                         /* and perform the assignment */
-                        irn = GGC_NEW(SDyn_IRNode);
-                        GGC_WD(irn, op, SDYN_NODE_ASSIGNMEMBER);
-                        GGC_WD(irn, left, g);
-                        GGC_WD(irn, right, val);
-                        GGC_WP(irn, immp, name);
-                        SDyn_IRNodeListPush(ir, irn);
+                        irn = irNodeZero;
+                        irn.op = SDYN_NODE_ASSIGNMEMBER;
+                        irn.left = g;
+                        irn.right = val;
+                        irn.str = tok.val;
+                        irn.strLen = tok.valLen;
+                        irPush(ir, &irn);
                     }
 
                     break;
                 }
 
                 default:
-                    fprintf(stderr, "Invalid assignment to %s!\n", sdyn_nodeNames[GGC_RD(cnode, type)]);
+                    fprintf(stderr, "Invalid assignment to %s!\n", sdyn_nodeNames[cnode->type]);
                     abort();
             }
             break;
 
         case SDYN_NODE_VARREF:
         {
-            size_t g;
+            size_t g, idx;
 
             /* just get it out of the symbol table */
-            tok = GGC_RD(node, tok);
-            name = sdyn_boxString(NULL, (char *) tok.val, tok.valLen);
-            if (SDyn_IndexMapGet(symbols, name, &indexBox))
-                return GGC_RD(indexBox, v);
+            tok = node->tok;
+            if (symbolGet(symbols, tok.val, tok.valLen, &idx))
+                return idx;
 
             /* not in the local symbol table, must be a global */
-            irn = GGC_NEW(SDyn_IRNode);
-            GGC_WD(irn, op, SDYN_NODE_TOP);
-            GGC_WD(irn, rtype, SDYN_TYPE_OBJECT);
-            g = GGC_RD(ir, length);
-            SDyn_IRNodeListPush(ir, irn);
+            irn = irNodeZero;
+            irn.op = SDYN_NODE_TOP;
+            irn.rtype = SDYN_TYPE_OBJECT;
+            g = irPush(ir, &irn);
 
             /* do a member lookup */
-            irn = GGC_NEW(SDyn_IRNode);
-            GGC_WD(irn, op, SDYN_NODE_MEMBER);
-            GGC_WD(irn, rtype, SDYN_TYPE_BOXED);
-            GGC_WD(irn, left, g);
-            tok = GGC_RD(node, tok);
-            name = sdyn_boxString(NULL, (char *) tok.val, tok.valLen);
-            GGC_WP(irn, immp, name);
-            SDyn_IRNodeListPush(ir, irn);
+            irn = irNodeZero;
+            irn.op = SDYN_NODE_MEMBER;
+            irn.rtype = SDYN_TYPE_BOXED;
+            irn.left = g;
+            irn.str = tok.val;
+            irn.strLen = tok.valLen;
+            irPush(ir, &irn);
 
             break;
         }
 
         case SDYN_NODE_IF:
         {
-            SDyn_IndexMap symbolsSwap;
+            struct SymbolTable *symbolsSwap;
             size_t nodeIf, nodeElse;
 
             /* check the condition */
             i = SUB(0);
 
             /* we'll need to unify both sides of the if */
-            symbols2 = cloneSymbolTable(symbols);
+            symbols2 = cloneSymbolTable(ir->arena, symbols);
 
             /* conditionally jump to else */
             IRNNEW();
-            GGC_WD(irn, left, i);
-            nodeIf = GGC_RD(ir, length);
-            SDyn_IRNodeListPush(ir, irn);
+            irn.left = i;
+            nodeIf = irPush(ir, &irn);
 
             /* do the if body */
             SUB(1);
 
             /* begin the else */
-            irn = GGC_NEW(SDyn_IRNode);
-            GGC_WD(irn, op, SDYN_NODE_IFELSE);
-            GGC_WD(irn, left, nodeIf);
-            nodeElse = GGC_RD(ir, length);
-            SDyn_IRNodeListPush(ir, irn);
+            irn = irNodeZero;
+            irn.op = SDYN_NODE_IFELSE;
+            irn.left = nodeIf;
+            nodeElse = irPush(ir, &irn);
 
             /* swap our symbol tables */
             symbolsSwap = symbols;
@@ -437,14 +711,14 @@ static size_t irCompileNode(SDyn_IRNodeList ir, SDyn_Node node, SDyn_IndexMap sy
             symbols2 = symbolsSwap;
 
             /* do the else body */
-            if (GGC_RAP(children, 2))
+            if (children->a[2])
                 SUB(2);
 
             /* then the end */
-            irn = GGC_NEW(SDyn_IRNode);
-            GGC_WD(irn, op, SDYN_NODE_IFEND);
-            GGC_WD(irn, left, nodeElse);
-            SDyn_IRNodeListPush(ir, irn);
+            irn = irNodeZero;
+            irn.op = SDYN_NODE_IFEND;
+            irn.left = nodeElse;
+            irPush(ir, &irn);
 
             /* and unify */
             unifySymbolTables(ir, symbols, symbols2, 0);
@@ -458,29 +732,27 @@ static size_t irCompileNode(SDyn_IRNodeList ir, SDyn_Node node, SDyn_IndexMap sy
 
             /* mark the beginning */
             IRNNEW();
-            begin = GGC_RD(ir, length);
-            SDyn_IRNodeListPush(ir, irn);
+            begin = irPush(ir, &irn);
 
             /* we'll need to compare our symbol table before and after to unify, so first, copy */
-            symbols2 = cloneSymbolTable(symbols);
+            symbols2 = cloneSymbolTable(ir->arena, symbols);
 
             /* now do the while condition */
             i = SUB(0); /* NOTE: actually need to unify here to be correct */
-            irn = GGC_NEW(SDyn_IRNode);
-            GGC_WD(irn, op, SDYN_NODE_WCOND);
-            GGC_WD(irn, left, i);
-            cond = GGC_RD(ir, length);
-            SDyn_IRNodeListPush(ir, irn);
+            irn = irNodeZero;
+            irn.op = SDYN_NODE_WCOND;
+            irn.left = i;
+            cond = irPush(ir, &irn);
 
             /* the loop body */
             SUB(1);
 
             /* and the loop end */
-            irn = GGC_NEW(SDyn_IRNode);
-            GGC_WD(irn, op, SDYN_NODE_WEND);
-            GGC_WD(irn, left, begin);
-            GGC_WD(irn, right, cond);
-            SDyn_IRNodeListPush(ir, irn);
+            irn = irNodeZero;
+            irn.op = SDYN_NODE_WEND;
+            irn.left = begin;
+            irn.right = cond;
+            irPush(ir, &irn);
 
             /* then unify our pre-loop and post-loop variables */
             unifySymbolTables(ir, symbols, symbols2, 1);
@@ -489,88 +761,144 @@ static size_t irCompileNode(SDyn_IRNodeList ir, SDyn_Node node, SDyn_IndexMap sy
 
         case SDYN_NODE_MEMBER:
             IRNNEW();
-            GGC_WD(irn, rtype, SDYN_TYPE_BOXED);
+            irn.rtype = SDYN_TYPE_BOXED;
 
             /* get the object */
             i = SUB(0);
             if (target) *target = i;
-            GGC_WD(irn, left, i);
+            irn.left = i;
 
             /* the name is the token */
-            tok = GGC_RD(node, tok);
-            name = sdyn_boxString(NULL, (char *) tok.val, tok.valLen);
-            GGC_WP(irn, immp, name);
+            tok = node->tok;
+            irn.str = tok.val;
+            irn.strLen = tok.valLen;
 
-            SDyn_IRNodeListPush(ir, irn);
+            irPush(ir, &irn);
 
             break;
 
         case SDYN_NODE_INDEX:
             IRNNEW();
-            GGC_WD(irn, rtype, SDYN_TYPE_BOXED);
+            irn.rtype = SDYN_TYPE_BOXED;
 
             /* get the object */
             i = SUB(0);
             if (target) *target = i;
-            GGC_WD(irn, left, i);
+            irn.left = i;
 
             /* and the index */
-            i = SUB(1);
-            GGC_WD(irn, right, i);
+            irn.right = SUB(1);
 
-            SDyn_IRNodeListPush(ir, irn);
+            irPush(ir, &irn);
             break;
 
         case SDYN_NODE_CALL:
         {
-            size_t f, target;
-
-            /* get the target and function to call */
+            struct SDyn_Node *decl;
+            const unsigned char *source;
+            size_t f, target, ifNode, ifElse, inlined;
+            int method;
+
+            /* get the target and function to call. Method calls look the
+             * method up as part of the call, unless the arguments could
+             * change it in the meantime. */
             target = 0;
-            cnode = GGC_RAP(children, 0);
-            f = irCompileNode(ir, cnode, symbols, &target);
+            cnode = children->a[0];
+            method = (cnode->type == SDYN_NODE_MEMBER && !hasEffects(children->a[1]));
+            if (method)
+                f = target = irCompileNode(ir, cnode->children->a[0], symbols, NULL);
+            else
+                f = irCompileNode(ir, cnode, symbols, &target);
 
             /* make room for argument values */
-            cnode = GGC_RAP(children, 1);
-            children = GGC_RP(cnode, children);
-            args = GGC_NEW_DA(size_t, children->length + 1);
+            cnode = children->a[1];
+            children = cnode->children;
+            argCt = children->length + 1;
+            args = sdyn_arenaAlloc(ir->arena, argCt * sizeof(size_t));
 
-            /* set the target argument */
+            /* set the target argument, undefined for plain calls */
             if (!target) {
-                irn = GGC_NEW(SDyn_IRNode);
-                GGC_WD(irn, op, SDYN_NODE_NIL);
-                GGC_WD(irn, rtype, SDYN_TYPE_BOXED);
-                target = GGC_RD(ir, length);
-                SDyn_IRNodeListPush(ir, irn);
+                irn = irNodeZero;
+                irn.op = SDYN_NODE_NIL;
+                irn.rtype = SDYN_TYPE_UNDEFINED;
+                target = irPush(ir, &irn);
             }
-            GGC_WAD(args, 0, target);
+            args[0] = target;
 
             /* evaluate all the arguments */
-            for (i = 0; i < children->length; i++) {
-                size_t v, anum;
-
-                v = SUB(i);
-                anum = i + 1;
-                GGC_WAD(args, anum, v);
-
+            for (i = 0; i < children->length; i++)
+                args[i + 1] = SUB(i);
+
+            /* small global functions are inlined, guarded by a check that the
+             * global is still the same function */
+            cnode = node->children->a[0];
+            decl = NULL;
+            if (cnode->type == SDYN_NODE_VARREF &&
+                !symbolGet(symbols, cnode->tok.val, cnode->tok.valLen, &i))
+                decl = inlineCandidate(ir, &cnode->tok, &source);
+            if (decl) {
+                irn = irNodeZero;
+                irn.op = SDYN_NODE_CHECKFUNC;
+                irn.rtype = SDYN_TYPE_BOOL;
+                irn.imm = (long) source;
+                irn.str = cnode->tok.val;
+                irn.strLen = cnode->tok.valLen;
+                irn.left = f;
+                i = irPush(ir, &irn);
+                irn = irNodeZero;
+                irn.op = SDYN_NODE_IF;
+                irn.left = i;
+                ifNode = irPush(ir, &irn);
+
+                inlined = irCompileInline(ir, decl, args, argCt);
+
+                irn = irNodeZero;
+                irn.op = SDYN_NODE_IFELSE;
+                irn.left = ifNode;
+                ifElse = irPush(ir, &irn);
             }
 
             /* put them in argument slots */
-            for (i = 0; i < args->length; i++) {
-                size_t v;
-                irn = GGC_NEW(SDyn_IRNode);
-                GGC_WD(irn, op, SDYN_NODE_ARG);
-                v = GGC_RAD(args, i);
-                GGC_WD(irn, left, v);
-                GGC_WD(irn, imm, i);
-                SDyn_IRNodeListPush(ir, irn);
+            for (i = 0; i < argCt; i++) {
+                irn = irNodeZero;
+                irn.op = SDYN_NODE_ARG;
+                irn.left = args[i];
+                irn.imm = i;
+                irPush(ir, &irn);
             }
 
-            /* now perform the call */
-            IRNNEW();
-            GGC_WD(irn, rtype, SDYN_TYPE_BOXED);
-            GGC_WD(irn, left, f);
-            SDyn_IRNodeListPush(ir, irn);
+            /* now perform the call. Recursive calls are marked with our
+             * source, so the JIT can turn them into jumps when they're in tail
+             * position. */
+            irn = irNodeZero;
+            irn.op = SDYN_NODE_CALL;
+            irn.rtype = SDYN_TYPE_BOXED;
+            irn.left = f;
+            cnode = node->children->a[0];
+            if (method) {
+                irn.op = SDYN_NODE_CALLMEMBER;
+                irn.str = cnode->tok.val;
+                irn.strLen = cnode->tok.valLen;
+            } else if (!ir->inlining && ir->selfSource && cnode->type == SDYN_NODE_VARREF &&
+                !symbolGet(symbols, cnode->tok.val, cnode->tok.valLen, &i) &&
+                globalSource(&cnode->tok, NULL) == ir->selfSource) {
+                irn.imm = (long) ir->selfSource;
+            }
+            i = irPush(ir, &irn);
+
+            if (decl) {
+                /* the result is whichever was run */
+                irn = irNodeZero;
+                irn.op = SDYN_NODE_IFEND;
+                irn.left = ifElse;
+                irPush(ir, &irn);
+                irn = irNodeZero;
+                irn.op = SDYN_NODE_UNIFY;
+                irn.rtype = SDYN_TYPE_BOXED;
+                irn.left = inlined;
+                irn.right = i;
+                irPush(ir, &irn);
+            }
 
             break;
         }
@@ -578,38 +906,32 @@ static size_t irCompileNode(SDyn_IRNodeList ir, SDyn_Node node, SDyn_IndexMap sy
         case SDYN_NODE_INTRINSICCALL:
         {
             /* make room for arguments */
-            cnode = GGC_RAP(children, 0);
-            children = GGC_RP(cnode, children);
-            args = GGC_NEW_DA(size_t, children->length);
+            cnode = children->a[0];
+            children = cnode->children;
+            argCt = children->length;
+            args = sdyn_arenaAlloc(ir->arena, argCt * sizeof(size_t));
 
             /* evaluate them */
-            for (i = 0; i < children->length; i++) {
-                size_t v;
-
-                v = SUB(i);
-                GGC_WAD(args, i, v);
-            }
+            for (i = 0; i < argCt; i++)
+                args[i] = SUB(i);
 
             /* put them in arg slots */
-            for (i = 0; i < args->length; i++) {
-                size_t v;
-
-                irn = GGC_NEW(SDyn_IRNode);
-                GGC_WD(irn, op, SDYN_NODE_ARG);
-                v = GGC_RAD(args, i);
-                GGC_WD(irn, left, v);
-                GGC_WD(irn, imm, i);
-                SDyn_IRNodeListPush(ir, irn);
+            for (i = 0; i < argCt; i++) {
+                irn = irNodeZero;
+                irn.op = SDYN_NODE_ARG;
+                irn.left = args[i];
+                irn.imm = i;
+                irPush(ir, &irn);
             }
 
             /* now perform the call */
             IRNNEW();
-            GGC_WD(irn, rtype, SDYN_TYPE_BOXED);
-            GGC_WD(irn, imm, i);
-            tok = GGC_RD(node, tok);
-            name = sdyn_boxString(NULL, (char *) tok.val, tok.valLen);
-            GGC_WP(irn, immp, name);
-            SDyn_IRNodeListPush(ir, irn);
+            irn.rtype = SDYN_TYPE_BOXED;
+            irn.imm = i;
+            tok = node->tok;
+            irn.str = tok.val;
+            irn.strLen = tok.valLen;
+            irPush(ir, &irn);
 
             break;
         }
@@ -617,60 +939,54 @@ static size_t irCompileNode(SDyn_IRNodeList ir, SDyn_Node node, SDyn_IndexMap sy
         /* 0-ary nodes: */
         case SDYN_NODE_NUM:
             IRNNEW();
-            GGC_WD(irn, rtype, SDYN_TYPE_INT);
-            tok = GGC_RD(node, tok);
-            name = sdyn_boxString(NULL, (char *) tok.val, tok.valLen);
-            {
-                long v = sdyn_toNumber(NULL, (SDyn_Undefined) name);
-                GGC_WD(irn, imm, v);
-            }
-            SDyn_IRNodeListPush(ir, irn);
+            irn.rtype = SDYN_TYPE_INT;
+            tok = node->tok;
+            for (i = 0; i < tok.valLen; i++)
+                irn.imm = irn.imm * 10 + (tok.val[i] - '0');
+            irPush(ir, &irn);
             break;
 
         case SDYN_NODE_STR:
             IRNNEW();
-            GGC_WD(irn, rtype, SDYN_TYPE_STRING);
-            tok = GGC_RD(node, tok);
-            name = sdyn_boxString(NULL, (char *) tok.val, tok.valLen);
-            GGC_WP(irn, immp, name); /* FIXME */
-            SDyn_IRNodeListPush(ir, irn);
+            irn.rtype = SDYN_TYPE_STRING;
+            tok = node->tok;
+            irn.str = tok.val;
+            irn.strLen = tok.valLen;
+            irPush(ir, &irn);
             break;
 
         case SDYN_NODE_FALSE:
         case SDYN_NODE_TRUE:
             IRNNEW();
-            GGC_WD(irn, rtype, SDYN_TYPE_BOOL);
-            SDyn_IRNodeListPush(ir, irn);
+            irn.rtype = SDYN_TYPE_BOOL;
+            irPush(ir, &irn);
             break;
 
         case SDYN_NODE_OBJ:
             IRNNEW();
-            GGC_WD(irn, rtype, SDYN_TYPE_OBJECT);
-            SDyn_IRNodeListPush(ir, irn);
+            irn.rtype = SDYN_TYPE_OBJECT;
+            irPush(ir, &irn);
             break;
 
         /* unary nodes: */
         case SDYN_NODE_RETURN:
             IRNNEW();
-            i = SUB(0);
-            GGC_WD(irn, left, i);
-            SDyn_IRNodeListPush(ir, irn);
+            irn.left = SUB(0);
+            irPush(ir, &irn);
             break;
 
         case SDYN_NODE_NOT:
             IRNNEW();
-            GGC_WD(irn, rtype, SDYN_TYPE_BOOL);
-            i = SUB(0);
-            GGC_WD(irn, left, i);
-            SDyn_IRNodeListPush(ir, irn);
+            irn.rtype = SDYN_TYPE_BOOL;
+            irn.left = SUB(0);
+            irPush(ir, &irn);
             break;
 
         case SDYN_NODE_TYPEOF:
             IRNNEW();
-            GGC_WD(irn, rtype, SDYN_TYPE_STRING);
-            i = SUB(0);
-            GGC_WD(irn, left, i);
-            SDyn_IRNodeListPush(ir, irn);
+            irn.rtype = SDYN_TYPE_STRING;
+            irn.left = SUB(0);
+            irPush(ir, &irn);
             break;
 
         /* binary nodes: */
@@ -683,48 +999,45 @@ static size_t irCompileNode(SDyn_IRNodeList ir, SDyn_Node node, SDyn_IndexMap sy
             cond1 = SUB(0);
 
             /* we need not-condition because or's the opposite case */
-            if (GGC_RD(node, type) == SDYN_NODE_OR) {
-                irn = GGC_NEW(SDyn_IRNode);
-                GGC_WD(irn, op, SDYN_NODE_NOT);
-                GGC_WD(irn, rtype, SDYN_TYPE_BOOL);
-                GGC_WD(irn, left, cond1);
-                cond1n = GGC_RD(ir, length);
-                SDyn_IRNodeListPush(ir, irn);
+            if (node->type == SDYN_NODE_OR) {
+                irn = irNodeZero;
+                irn.op = SDYN_NODE_NOT;
+                irn.rtype = SDYN_TYPE_BOOL;
+                irn.left = cond1;
+                cond1n = irPush(ir, &irn);
             } else {
                 cond1n = cond1;
             }
 
             /* compile it as an if */
-            irn = GGC_NEW(SDyn_IRNode);
-            GGC_WD(irn, op, SDYN_NODE_IF);
-            GGC_WD(irn, left, cond1n);
-            ifNode = GGC_RD(ir, length);
-            SDyn_IRNodeListPush(ir, irn);
+            irn = irNodeZero;
+            irn.op = SDYN_NODE_IF;
+            irn.left = cond1n;
+            ifNode = irPush(ir, &irn);
 
             /* the second condition is optional, so need to unify */
-            symbols2 = cloneSymbolTable(symbols);
+            symbols2 = cloneSymbolTable(ir->arena, symbols);
 
             /* get the second condition */
             cond2 = SUB(1);
 
             /* end the if */
-            irn = GGC_NEW(SDyn_IRNode);
-            GGC_WD(irn, op, SDYN_NODE_IFELSE);
-            GGC_WD(irn, left, ifNode);
-            ifElse = GGC_RD(ir, length);
-            SDyn_IRNodeListPush(ir, irn);
-            irn = GGC_NEW(SDyn_IRNode);
-            GGC_WD(irn, op, SDYN_NODE_IFEND);
-            GGC_WD(irn, left, ifElse);
-            SDyn_IRNodeListPush(ir, irn);
+            irn = irNodeZero;
+            irn.op = SDYN_NODE_IFELSE;
+            irn.left = ifNode;
+            ifElse = irPush(ir, &irn);
+            irn = irNodeZero;
+            irn.op = SDYN_NODE_IFEND;
+            irn.left = ifElse;
+            irPush(ir, &irn);
 
             /* then unify */
-            irn = GGC_NEW(SDyn_IRNode);
-            GGC_WD(irn, op, SDYN_NODE_UNIFY);
-            GGC_WD(irn, rtype, SDYN_TYPE_BOXED);
-            GGC_WD(irn, left, cond1);
-            GGC_WD(irn, right, cond2);
-            SDyn_IRNodeListPush(ir, irn);
+            irn = irNodeZero;
+            irn.op = SDYN_NODE_UNIFY;
+            irn.rtype = SDYN_TYPE_BOXED;
+            irn.left = cond1;
+            irn.right = cond2;
+            irPush(ir, &irn);
             unifySymbolTables(ir, symbols, symbols2, 0);
             break;
         }
@@ -736,22 +1049,18 @@ static size_t irCompileNode(SDyn_IRNodeList ir, SDyn_Node node, SDyn_IndexMap sy
         case SDYN_NODE_LE:
         case SDYN_NODE_GE:
             IRNNEW();
-            GGC_WD(irn, rtype, SDYN_TYPE_BOOL);
-            i = SUB(0);
-            GGC_WD(irn, left, i);
-            i = SUB(1);
-            GGC_WD(irn, right, i);
-            SDyn_IRNodeListPush(ir, irn);
+            irn.rtype = SDYN_TYPE_BOOL;
+            irn.left = SUB(0);
+            irn.right = SUB(1);
+            irPush(ir, &irn);
             break;
 
         case SDYN_NODE_ADD:
             IRNNEW();
-            GGC_WD(irn, rtype, SDYN_TYPE_BOXED);
-            i = SUB(0);
-            GGC_WD(irn, left, i);
-            i = SUB(1);
-            GGC_WD(irn, right, i);
-            SDyn_IRNodeListPush(ir, irn);
+            irn.rtype = SDYN_TYPE_BOXED;
+            irn.left = SUB(0);
+            irn.right = SUB(1);
+            irPush(ir, &irn);
             break;
 
         case SDYN_NODE_SUB:
@@ -759,17 +1068,15 @@ static size_t irCompileNode(SDyn_IRNodeList ir, SDyn_Node node, SDyn_IndexMap sy
         case SDYN_NODE_MOD:
         case SDYN_NODE_DIV:
             IRNNEW();
-            GGC_WD(irn, rtype, SDYN_TYPE_INT);
-            i = SUB(0);
-            GGC_WD(irn, left, i);
-            i = SUB(1);
-            GGC_WD(irn, right, i);
-            SDyn_IRNodeListPush(ir, irn);
+            irn.rtype = SDYN_TYPE_INT;
+            irn.left = SUB(0);
+            irn.right = SUB(1);
+            irPush(ir, &irn);
             break;
 
         default:
             fprintf(stderr, "Unsupported node %s! (%.*s)\n",
-                sdyn_nodeNames[GGC_RD(node, type)], (int) GGC_RD(node, tok).valLen, GGC_RD(node, tok).val);
+                sdyn_nodeNames[node->type], (int) node->tok.valLen, node->tok.val);
             abort();
     }
 
@@ -777,244 +1084,964 @@ static size_t irCompileNode(SDyn_IRNodeList ir, SDyn_Node node, SDyn_IndexMap sy
 #undef IRNNEW
 
     /* with no other return known, we assume the last IR node is the result */
-    return GGC_RD(ir, length) - 1;
+    return ir->length - 1;
 }
 
 /* set up the uidxs for all nodes */
-static void irUidx(SDyn_IRNodeArray ir)
+static void irUidx(struct SDyn_IR *ir)
 {
-    SDyn_IRNode node = NULL, unode = NULL;
     ssize_t si;
-    size_t idx, uidx;
-
-    GGC_PUSH_3(ir, node, unode);
+    size_t idx;
 
     /* first off, default uidxs */
+    for (si = ir->length - 1; si >= 0; si--)
+        ir->uidx[si] = si;
+
+    /* then unify. The type of a unification isn't known until types have
+     * been flowed, so start it as NIL, i.e., unknown */
     for (si = ir->length - 1; si >= 0; si--) {
-        node = GGC_RAP(ir, si);
-        GGC_WD(node, uidx, si);
+        if (ir->op[si] == SDYN_NODE_UNIFY) {
+            idx = ir->uidx[si];
+            ir->rtype[si] = SDYN_TYPE_NIL;
+            ir->uidx[ir->left[si]] = idx;
+            ir->uidx[ir->right[si]] = idx;
+        }
     }
 
-    /* then unify */
-    for (si = ir->length - 1; si >= 0; si--) {
-        node = GGC_RAP(ir, si);
-
-        if (GGC_RD(node, op) == SDYN_NODE_UNIFY) {
-            idx = GGC_RD(node, uidx);
-            GGC_WD(node, rtype, SDYN_TYPE_BOXED);
-            unode = GGC_RAP(ir, GGC_RD(node, left));
-            GGC_WD(unode, uidx, idx);
-            unode = GGC_RAP(ir, GGC_RD(node, right));
-            GGC_WD(unode, uidx, idx);
+    /* and point every node directly at the root of its unification chain, so
+     * that later passes needn't walk the chains */
+    for (si = 0; si < ir->length; si++) {
+        idx = ir->uidx[si];
+        while (ir->uidx[idx] != idx)
+            idx = ir->uidx[idx];
+        ir->uidx[si] = idx;
+    }
+}
+
+/* a node for irInsert to insert */
+struct IRInsertion {
+    size_t after; /* the existing node to insert it after */
+    struct SDyn_IRNode node;
+};
+
+/* a growable list of insertions */
+struct IRInsertions {
+    struct IRInsertion *ins;
+    size_t count, capacity;
+};
+
+/* queue a node to be inserted after an existing one. Returns the index by
+ * which other nodes may refer to it until irInsert */
+static size_t irQueueInsertion(struct SDyn_IR *ir, struct IRInsertions *ins, size_t after, struct SDyn_IRNode *node)
+{
+    if (ins->count >= ins->capacity) {
+        size_t capacity = ins->capacity ? ins->capacity * 2 : 16;
+        ins->ins = sdyn_arenaRealloc(ir->arena, ins->ins,
+            ins->capacity * sizeof(struct IRInsertion),
+            capacity * sizeof(struct IRInsertion));
+        ins->capacity = capacity;
+    }
+    ins->ins[ins->count].after = after;
+    ins->ins[ins->count].node = *node;
+    return ir->length + ins->count++;
+}
+
+/* rebuild the IR with the queued nodes inserted. Until then, operands may
+ * refer to the kth queued node as ir->length + k. Unification must be redone
+ * afterwards. */
+static void irInsert(struct SDyn_IR *ir, struct IRInsertions *ins)
+{
+    struct SDyn_IR old = *ir;
+    struct SDyn_IRNode irn;
+    size_t *order, *map;
+    size_t i, j, k, n, si;
+
+    /* put the insertions in order, keeping the order of those at the same place */
+    order = sdyn_arenaAlloc(ir->arena, ins->count * sizeof(size_t));
+    for (i = 0; i < ins->count; i++) {
+        for (j = i; j > 0 && ins->ins[order[j - 1]].after > ins->ins[i].after; j--)
+            order[j] = order[j - 1];
+        order[j] = i;
+    }
+
+    /* find where every node will end up */
+    map = sdyn_arenaAlloc(ir->arena, (old.length + ins->count) * sizeof(size_t));
+    for (i = k = n = 0; i < old.length; i++) {
+        map[i] = n++;
+        for (; k < ins->count && ins->ins[order[k]].after == i; k++)
+            map[old.length + order[k]] = n++;
+    }
+
+    /* then start from nothing and push it all again */
+    ir->length = ir->capacity = 0;
+    ir->op = ir->rtype = ir->stype = NULL;
+    ir->imm = NULL;
+    ir->left = ir->right = ir->third = ir->addr = ir->uidx = NULL;
+    ir->strs = NULL;
+    ir->strCount = ir->strCapacity = 0;
+    for (i = k = si = 0; i < old.length; i++) {
+        irn = irNodeZero;
+        irn.op = old.op[i];
+        irn.rtype = old.rtype[i];
+        irn.imm = old.imm[i];
+        irn.left = map[old.left[i]];
+        irn.right = map[old.right[i]];
+        irn.third = map[old.third[i]];
+
+        /* nodes rewritten into assignments have no more use for their strings */
+        if (si < old.strCount && old.strs[si].node == i) {
+            if (irn.op != SDYN_NODE_ASSIGN) {
+                irn.str = old.strs[si].str;
+                irn.strLen = old.strs[si].strLen;
+            }
+            si++;
+        }
+        irPush(ir, &irn);
+
+        for (; k < ins->count && ins->ins[order[k]].after == i; k++) {
+            irn = ins->ins[order[k]].node;
+            irn.left = map[irn.left];
+            irn.right = map[irn.right];
+            irn.third = map[irn.third];
+            irPush(ir, &irn);
         }
     }
 }
 
-/* flow IR types through operations */
-static void irFlowTypes(SDyn_IRNodeArray ir)
+/* does node a dominate node b? */
+static int irDominates(struct SDyn_CFG *cfg, size_t a, size_t b)
 {
-    SDyn_IRNode node = NULL, unode = NULL, onode = NULL;
-    int changed;
-    int leftType, rightType, thirdType, origTargetType, targetType;
-    size_t i, uidx;
+    size_t ba = cfg->nodeBlock[a], bb = cfg->nodeBlock[b];
+    if (ba == bb) return a < b;
+    return sdyn_cfgDominates(cfg, ba, bb);
+}
+
+/* Scalar replacement: an object which is only ever stored in one local
+ * variable, and whose only uses (directly or through that variable) are reads
+ * and writes of its members, can't be seen by anything else. Each of its
+ * members can then be a variable of its own, and the object need never be
+ * allocated at all. Anything else done with the object (passing it, returning
+ * it, storing it in another object, copying it to another variable, calling
+ * its methods) is an escape, and leaves it as it is. */
+
+/* is this value part of the object's web, i.e., the object itself or the
+ * variable holding it? */
+#define INWEB(v) ((v) && ((v) == o || (var && ir->uidx[v] == var)))
+
+/* is this value the object itself, rather than what the variable held before
+ * the object was assigned to it? */
+#define DIRECT(v) ((v) == o || (ir->op[v] == SDYN_NODE_ASSIGN && ir->left[v] == o))
+
+/* find the variable holding this object, or 0 if it has none, or (size_t) -1
+ * if the object escapes */
+static size_t irNonEscaping(struct SDyn_IR *ir, struct SDyn_CFG *cfg, size_t o)
+{
+    size_t var = 0, i;
 
-    GGC_PUSH_4(ir, node, unode, onode);
+    if (ir->uidx[o] != o) return (size_t) -1;
 
-    do {
-        changed = 0;
+    /* find the variable */
+    for (i = 0; i < ir->length; i++) {
+        if (ir->op[i] == SDYN_NODE_ASSIGN && ir->left[i] == o) {
+            if (var && ir->uidx[i] != var) return (size_t) -1;
+            var = ir->uidx[i];
+        }
+    }
+
+    /* which may only ever hold this object, or the undefined it's declared with */
+    if (var) {
         for (i = 0; i < ir->length; i++) {
-            /* get the node and its unification target */
-            node = GGC_RAP(ir, i);
-            unode = node;
-            uidx = i;
-            while (GGC_RD(unode, uidx) != uidx) {
-                uidx = GGC_RD(unode, uidx);
-                unode = GGC_RAP(ir, uidx);
+            if (ir->uidx[i] != var) continue;
+            switch (ir->op[i]) {
+                case SDYN_NODE_NIL:
+                case SDYN_NODE_UNIFY:
+                    break;
+
+                case SDYN_NODE_ASSIGN:
+                    if (ir->left[i] == o) break;
+                    /* fallthrough */
+
+                default:
+                    return (size_t) -1;
             }
-            targetType = GGC_RD(unode, rtype);
-
-            /* get all its operands */
-#define OPTYPE(op) do { \
-    uidx = GGC_RD(node, op); \
-    onode = GGC_RAP(ir, uidx); \
-    while (GGC_RD(onode, uidx) != uidx) { \
-        uidx = GGC_RD(onode, uidx); \
-        onode = GGC_RAP(ir, uidx); \
-    } \
-    op ## Type = GGC_RD(onode, rtype); \
+        }
+    }
+
+    /* and check every use */
+    for (i = 0; i < ir->length; i++) {
+        if (INWEB(ir->right[i]) || INWEB(ir->third[i])) {
+            /* only unification may use it as anything but the left operand */
+            if (ir->op[i] != SDYN_NODE_UNIFY) return (size_t) -1;
+            continue;
+        }
+        if (!INWEB(ir->left[i])) continue;
+
+        switch (ir->op[i]) {
+            case SDYN_NODE_ASSIGNMEMBER:
+                /* the write must be ours alone to redirect */
+                if (ir->uidx[i] != i) return (size_t) -1;
+                /* fallthrough */
+
+            case SDYN_NODE_MEMBER:
+                /* must definitely be accessing the object, not undefined */
+                if (!DIRECT(ir->left[i]) || !irDominates(cfg, ir->left[i], i))
+                    return (size_t) -1;
+                break;
+
+            case SDYN_NODE_ASSIGN:
+                if (ir->left[i] == o) break;
+                return (size_t) -1;
+
+            case SDYN_NODE_NOP:
+            case SDYN_NODE_UNIFY:
+                break;
+
+            default:
+                return (size_t) -1;
+        }
+    }
+
+    return var;
+}
+
+/* replace one member of a non-escaping object with a variable. acc are the
+ * nodes accessing it, in order */
+static void irReplaceMember(struct SDyn_IR *ir, struct SDyn_CFG *cfg, struct IRInsertions *ins,
+    size_t o, size_t *acc, size_t accCount)
+{
+    struct SDyn_IRNode irn;
+    size_t first, def, last, i, j, w, v;
+    int reads, init, covered;
+
+    /* a read which no write dominates may see the member before it's set */
+    reads = init = 0;
+    for (i = 0; i < accCount; i++) {
+        if (ir->op[acc[i]] != SDYN_NODE_MEMBER) continue;
+        reads = 1;
+        covered = 0;
+        for (j = 0; j < accCount && !covered; j++) {
+            if (ir->op[acc[j]] == SDYN_NODE_ASSIGNMEMBER && irDominates(cfg, acc[j], acc[i]))
+                covered = 1;
+        }
+        if (!covered) init = 1;
+    }
+
+    /* the variable has to stay alive as long as anything touches it, and, like
+     * any variable, through the end of any loop that does */
+    last = o;
+    for (i = 0; i < accCount; i++)
+        if (acc[i] > last) last = acc[i];
+    for (i = 0; i < ir->length; i++) {
+        if (ir->op[i] != SDYN_NODE_WEND) continue;
+        for (j = 0; j < accCount; j++) {
+            if (ir->left[i] < acc[j] && acc[j] < i) {
+                last = i;
+                break;
+            }
+        }
+    }
+
+    /* if it may be read before it's set, it starts out undefined with the
+     * object */
+    first = def = 0;
+    if (init) {
+        irn = irNodeZero;
+        irn.op = SDYN_NODE_NIL;
+        irn.rtype = SDYN_TYPE_UNDEFINED;
+        first = def = irQueueInsertion(ir, ins, o, &irn);
+    }
+
+    /* writes become assignments to the variable. Anything using the write's
+     * own result gets the value written instead, as the variable may be
+     * reassigned before it's used */
+    for (i = 0; i < accCount; i++) {
+        w = acc[i];
+        if (ir->op[w] != SDYN_NODE_ASSIGNMEMBER) continue;
+        v = ir->right[w];
+        for (j = w + 1; j < ir->length; j++) {
+            if (ir->left[j] == w) ir->left[j] = v;
+            if (ir->right[j] == w) ir->right[j] = v;
+            if (ir->third[j] == w) ir->third[j] = v;
+        }
+        ir->op[w] = SDYN_NODE_ASSIGN;
+        ir->left[w] = v;
+        ir->right[w] = 0;
+
+        /* unify it with the rest of the variable, if it's ever read */
+        if (!reads) continue;
+        if (def) {
+            irn = irNodeZero;
+            irn.op = SDYN_NODE_UNIFY;
+            irn.rtype = SDYN_TYPE_BOXED;
+            irn.left = def;
+            irn.right = w;
+            def = irQueueInsertion(ir, ins, last, &irn);
+        } else {
+            first = def = w;
+        }
+    }
+    if (!reads) return;
+
+    /* reads become copies of it. Every read follows its first definition,
+     * which is either the initialization or a write dominating the read */
+    for (i = 0; i < accCount; i++) {
+        if (ir->op[acc[i]] != SDYN_NODE_MEMBER) continue;
+        ir->op[acc[i]] = SDYN_NODE_ASSIGN;
+        ir->left[acc[i]] = first;
+    }
+
+    /* and NOP it so it stays alive for loops */
+    irn = irNodeZero;
+    irn.op = SDYN_NODE_NOP;
+    irn.left = def;
+    irQueueInsertion(ir, ins, last, &irn);
+}
+
+/* replace every object which doesn't escape with variables for its members */
+static void irScalarReplace(struct SDyn_IR *ir)
+{
+    struct SDyn_CFG *cfg;
+    struct IRInsertions ins;
+    const unsigned char *name, *name2;
+    size_t nameLen, name2Len;
+    size_t *vars, *acc, *macc;
+    char *done;
+    size_t accCount, maccCount, o, var, i, j;
+    int replaced;
+
+    /* decide which objects to replace before changing anything */
+    cfg = sdyn_irBuildCFG(ir);
+    vars = sdyn_arenaAlloc(ir->arena, ir->length * sizeof(size_t));
+    replaced = 0;
+    for (o = 0; o < ir->length; o++) {
+        vars[o] = (size_t) -1;
+        if (ir->op[o] == SDYN_NODE_OBJ) {
+            vars[o] = irNonEscaping(ir, cfg, o);
+            if (vars[o] != (size_t) -1) replaced = 1;
+        }
+    }
+    if (!replaced) return;
+
+    ins.ins = NULL;
+    ins.count = ins.capacity = 0;
+    acc = sdyn_arenaAlloc(ir->arena, ir->length * sizeof(size_t));
+    macc = sdyn_arenaAlloc(ir->arena, ir->length * sizeof(size_t));
+    done = sdyn_arenaAlloc(ir->arena, ir->length);
+    for (o = 0; o < ir->length; o++) {
+        var = vars[o];
+        if (var == (size_t) -1) continue;
+
+        /* find its member accesses */
+        accCount = 0;
+        for (i = 0; i < ir->length; i++) {
+            if ((ir->op[i] == SDYN_NODE_MEMBER || ir->op[i] == SDYN_NODE_ASSIGNMEMBER) &&
+                INWEB(ir->left[i])) {
+                done[accCount] = 0;
+                acc[accCount++] = i;
+            }
+        }
+
+        /* and replace them a member at a time */
+        for (i = 0; i < accCount; i++) {
+            if (done[i]) continue;
+            name = sdyn_irString(ir, acc[i], &nameLen);
+            maccCount = 0;
+            for (j = i; j < accCount; j++) {
+                name2 = sdyn_irString(ir, acc[j], &name2Len);
+                if (!done[j] && name2Len == nameLen && !memcmp(name, name2, nameLen)) {
+                    done[j] = 1;
+                    macc[maccCount++] = acc[j];
+                }
+            }
+            irReplaceMember(ir, cfg, &ins, o, macc, maccCount);
+        }
+
+        /* leaving nothing for the object itself to do */
+        ir->op[o] = SDYN_NODE_NIL;
+        ir->rtype[o] = SDYN_TYPE_UNDEFINED;
+    }
+
+    irInsert(ir, &ins);
+    irUidx(ir);
+}
+
+#undef INWEB
+#undef DIRECT
+
+/* build a compressed adjacency list from a list of edges */
+static size_t *irAdjacency(struct SDyn_IR *ir, size_t *from, size_t *to, size_t count, size_t **startp)
+{
+    size_t *start, *adj;
+    size_t i;
+
+    start = sdyn_arenaAlloc(ir->arena, (ir->length + 1) * sizeof(size_t));
+    for (i = 0; i < count; i++)
+        start[from[i] + 1]++;
+    for (i = 0; i < ir->length; i++)
+        start[i + 1] += start[i];
+
+    /* fill in each node's list, advancing its start as we go */
+    adj = sdyn_arenaAlloc(ir->arena, count * sizeof(size_t));
+    for (i = 0; i < count; i++)
+        adj[start[from[i]]++] = to[i];
+
+    /* which leaves each start at the next node's start, so shift them back */
+    for (i = ir->length; i > 0; i--)
+        start[i] = start[i - 1];
+    start[0] = 0;
+
+    *startp = start;
+    return adj;
+}
+
+/* the type of a location which may hold either of these types. NIL is
+ * unknown, so joins with anything. */
+static int irJoinTypes(int a, int b)
+{
+    if (a == SDYN_TYPE_NIL || a == b) return b;
+    if (b == SDYN_TYPE_NIL) return a;
+
+    if ((a == SDYN_TYPE_BOOL && b == SDYN_TYPE_BOXED_BOOL) ||
+        (a == SDYN_TYPE_BOXED_BOOL && b == SDYN_TYPE_BOOL))
+        return SDYN_TYPE_BOXED_BOOL;
+
+    if ((a == SDYN_TYPE_INT && b == SDYN_TYPE_BOXED_INT) ||
+        (a == SDYN_TYPE_BOXED_INT && b == SDYN_TYPE_INT))
+        return SDYN_TYPE_BOXED_INT;
+
+    return SDYN_TYPE_BOXED;
+}
+
+/* find the dependencies between nodes. A node's result depends on its
+ * operands' unification roots. A unification root's result depends on every
+ * value unified into it, and any other UNIFY just follows its root. */
+static void irDependencies(struct SDyn_IR *ir)
+{
+    size_t *from, *to;
+    size_t edges, i;
+
+    from = sdyn_arenaAlloc(ir->arena, ir->length * 4 * sizeof(size_t));
+    to = sdyn_arenaAlloc(ir->arena, ir->length * 4 * sizeof(size_t));
+    edges = 0;
+#define EDGE(f, t) do { \
+    from[edges] = (f); \
+    to[edges] = (t); \
+    edges++; \
 } while(0)
-            OPTYPE(left);
-            OPTYPE(right);
-            OPTYPE(third);
+    for (i = 0; i < ir->length; i++) {
+        if (ir->left[i]) EDGE(ir->uidx[ir->left[i]], i);
+        if (ir->right[i]) EDGE(ir->uidx[ir->right[i]], i);
+        if (ir->third[i]) EDGE(ir->uidx[ir->third[i]], i);
+        if (ir->uidx[i] != i) {
+            if (ir->op[i] == SDYN_NODE_UNIFY)
+                EDGE(ir->uidx[i], i);
+            else
+                EDGE(i, ir->uidx[i]);
+        }
+    }
+    ir->users = irAdjacency(ir, from, to, edges, &ir->usersStart);
+
+    /* and the list of values unified into each root */
+    edges = 0;
+    for (i = 0; i < ir->length; i++) {
+        if (ir->uidx[i] != i && ir->op[i] != SDYN_NODE_UNIFY)
+            EDGE(ir->uidx[i], i);
+    }
+    ir->members = irAdjacency(ir, from, to, edges, &ir->membersStart);
+#undef EDGE
+}
+
+/* a queue of nodes to (re)visit in a dataflow pass */
+struct Worklist {
+    size_t *work;
+    char *inWork;
+    size_t head, count;
+};
+
+/* start a worklist with every node on it, in order */
+static struct Worklist *workNew(struct SDyn_IR *ir)
+{
+    struct Worklist *wl;
+    size_t i;
+
+    wl = sdyn_arenaAlloc(ir->arena, sizeof(struct Worklist));
+    wl->work = sdyn_arenaAlloc(ir->arena, ir->length * sizeof(size_t));
+    wl->inWork = sdyn_arenaAlloc(ir->arena, ir->length);
+    for (i = 0; i < ir->length; i++) {
+        wl->work[i] = i;
+        wl->inWork[i] = 1;
+    }
+    wl->count = ir->length;
+
+    return wl;
+}
+
+/* get the next node from a worklist */
+static size_t workPop(struct SDyn_IR *ir, struct Worklist *wl)
+{
+    size_t ret = wl->work[wl->head];
+    wl->head = (wl->head + 1) % ir->length;
+    wl->count--;
+    wl->inWork[ret] = 0;
+    return ret;
+}
+
+/* a node's result changed, so (re)visit everything depending on it */
+static void workUsers(struct SDyn_IR *ir, struct Worklist *wl, size_t node)
+{
+    size_t i, user;
+
+    for (i = ir->usersStart[node]; i < ir->usersStart[node + 1]; i++) {
+        user = ir->users[i];
+        if (!wl->inWork[user]) {
+            wl->work[(wl->head + wl->count) % ir->length] = user;
+            wl->count++;
+            wl->inWork[user] = 1;
+        }
+    }
+}
+
+/* flow IR types through operations */
+static void irFlowTypes(struct SDyn_IR *ir)
+{
+    struct Worklist *wl;
+    int leftType, rightType, thirdType, origTargetType, targetType;
+    size_t i, j;
+
+    wl = workNew(ir);
+    while (wl->count) {
+        i = workPop(ir, wl);
+
+        /* get all its operands */
+#define OPTYPE(opnd) opnd ## Type = ir->rtype[ir->uidx[ir->opnd[i]]]
+        OPTYPE(left);
+        OPTYPE(right);
+        OPTYPE(third);
 #undef OPTYPE
-            origTargetType = targetType = GGC_RD(node, rtype);
+        origTargetType = targetType = ir->rtype[i];
 
-            /* then choose the result type */
-            switch (GGC_RD(node, op)) {
-                case SDYN_NODE_ASSIGN:
-                    /* just an alias */
-                    targetType = leftType;
-                    break;
+        /* then choose the result type */
+        switch (ir->op[i]) {
+            case SDYN_NODE_ASSIGN:
+                /* just an alias */
+                targetType = leftType;
+                break;
 
-                case SDYN_NODE_ASSIGNMEMBER:
-                    /* alias with an assignment */
-                    targetType = rightType;
-                    break;
+            case SDYN_NODE_ASSIGNMEMBER:
+                /* alias with an assignment */
+                targetType = rightType;
+                break;
 
-                case SDYN_NODE_ASSIGNINDEX:
-                    /* alias with an index */
-                    targetType = thirdType;
-                    break;
+            case SDYN_NODE_ASSIGNINDEX:
+                /* alias with an index */
+                targetType = thirdType;
+                break;
 
-                case SDYN_NODE_ADD:
-                    /* in some specific cases, we can predict the result type */
-                    if ((leftType == SDYN_TYPE_INT || leftType == SDYN_TYPE_BOXED_INT) &&
-                            (rightType == SDYN_TYPE_INT || rightType == SDYN_TYPE_BOXED_INT)) {
-                        /* both ints, result is int */
-                        targetType = SDYN_TYPE_INT;
+            case SDYN_NODE_ADD:
+                /* in some specific cases, we can predict the result type */
+                if (leftType == SDYN_TYPE_NIL || rightType == SDYN_TYPE_NIL) {
+                    /* wait until we know what we're adding */
+                    targetType = SDYN_TYPE_NIL;
 
-                    } else if (leftType != SDYN_TYPE_BOXED && rightType != SDYN_TYPE_BOXED) {
-                        /* both types are known, but they're not both ints, so the result is a string */
-                        targetType = SDYN_TYPE_STRING;
+                } else if ((leftType == SDYN_TYPE_INT || leftType == SDYN_TYPE_BOXED_INT) &&
+                        (rightType == SDYN_TYPE_INT || rightType == SDYN_TYPE_BOXED_INT)) {
+                    /* both ints, result is int */
+                    targetType = SDYN_TYPE_INT;
 
-                    } else if ((leftType == SDYN_TYPE_BOXED && rightType != SDYN_TYPE_BOXED && rightType != SDYN_TYPE_INT && rightType != SDYN_TYPE_BOXED_INT) ||
-                               (rightType == SDYN_TYPE_BOXED && leftType != SDYN_TYPE_BOXED && leftType != SDYN_TYPE_INT && rightType != SDYN_TYPE_BOXED_INT)) {
-                        /* one side or the other is not an int, so the result must be a string */
-                        targetType = SDYN_TYPE_STRING;
+                } else if (leftType != SDYN_TYPE_BOXED && rightType != SDYN_TYPE_BOXED) {
+                    /* both types are known, but they're not both ints, so the result is a string */
+                    targetType = SDYN_TYPE_STRING;
 
-                    }
-                    break;
+                } else if ((leftType == SDYN_TYPE_BOXED && rightType != SDYN_TYPE_BOXED && rightType != SDYN_TYPE_INT && rightType != SDYN_TYPE_BOXED_INT) ||
+                           (rightType == SDYN_TYPE_BOXED && leftType != SDYN_TYPE_BOXED && leftType != SDYN_TYPE_INT && rightType != SDYN_TYPE_BOXED_INT)) {
+                    /* one side or the other is not an int, so the result must be a string */
+                    targetType = SDYN_TYPE_STRING;
 
-                case SDYN_NODE_UNIFY:
-                    /* if both sides are the same type, then the unification needn't be blind boxing */
-                    if (leftType == rightType) {
-                        targetType = leftType;
+                } else {
+                    targetType = SDYN_TYPE_BOXED;
 
-                    } else if ((leftType == SDYN_TYPE_BOOL && rightType == SDYN_TYPE_BOXED_BOOL) ||
-                            (leftType == SDYN_TYPE_BOXED_BOOL && rightType == SDYN_TYPE_BOOL)) {
-                        targetType = SDYN_TYPE_BOXED_BOOL;
+                }
+                break;
 
-                    } else if ((leftType == SDYN_TYPE_INT && rightType == SDYN_TYPE_BOXED_INT) ||
-                            (leftType == SDYN_TYPE_BOXED_INT && rightType == SDYN_TYPE_INT)) {
-                        targetType = SDYN_TYPE_BOXED_INT;
+            case SDYN_NODE_UNIFY:
+                /* the root takes the join of everything unified into it, so
+                 * that, e.g., a loop variable which is only ever assigned ints
+                 * stays an unboxed int */
+                if (ir->uidx[i] == i) {
+                    targetType = SDYN_TYPE_NIL;
+                    for (j = ir->membersStart[i]; j < ir->membersStart[i + 1]; j++)
+                        targetType = irJoinTypes(targetType, ir->rtype[ir->members[j]]);
+                } else {
+                    targetType = ir->rtype[ir->uidx[i]];
+                }
+                break;
+        }
 
-                    }
-                    break;
-            }
+        if (origTargetType != targetType) {
+            /* we chose a more precise type, so anything depending on it must be rechecked */
+            ir->rtype[i] = targetType;
+            workUsers(ir, wl, i);
+        }
 
-            if (origTargetType != targetType) {
-                /* we chose a more precise type */
-                GGC_WD(node, rtype, targetType);
-                changed = 1;
+        /* if anything is still unknown, it's only dependent on other unknowns
+         * (e.g. a loop with no way in), so give up on it */
+        if (!wl->count) {
+            for (i = 0; i < ir->length; i++) {
+                if (ir->rtype[i] != SDYN_TYPE_NIL) continue;
+                switch (ir->op[i]) {
+                    case SDYN_NODE_ASSIGN:
+                    case SDYN_NODE_ASSIGNMEMBER:
+                    case SDYN_NODE_ASSIGNINDEX:
+                    case SDYN_NODE_ADD:
+                    case SDYN_NODE_UNIFY:
+                        ir->rtype[i] = SDYN_TYPE_BOXED;
+                        workUsers(ir, wl, i);
+                        break;
+                }
             }
         }
-    } while(changed);
+    }
+}
+
+/* the range of an operand, or of any long if it's not an integer */
+static void irOperandRange(struct SDyn_IR *ir, size_t opnd, long *min, long *max)
+{
+    size_t uidx = ir->uidx[opnd];
+    if (SDYN_TYPE_INTEGRAL(ir->rtype[uidx])) {
+        *min = ir->rangeMin[uidx];
+        *max = ir->rangeMax[uidx];
+    } else {
+        *min = LONG_MIN;
+        *max = LONG_MAX;
+    }
+}
+
+/* the range of an arithmetic operation, or of any long if it may overflow */
+static void irArithRange(int op, long lmin, long lmax, long rmin, long rmax, long *min, long *max)
+{
+    long corners[4];
+    int overflow, ci;
+
+    overflow = 0;
+    switch (op) {
+        case SDYN_NODE_ADD:
+            overflow |= __builtin_add_overflow(lmin, rmin, &corners[0]);
+            overflow |= __builtin_add_overflow(lmax, rmax, &corners[1]);
+            corners[2] = corners[0];
+            corners[3] = corners[1];
+            break;
+
+        case SDYN_NODE_SUB:
+            overflow |= __builtin_sub_overflow(lmin, rmax, &corners[0]);
+            overflow |= __builtin_sub_overflow(lmax, rmin, &corners[1]);
+            corners[2] = corners[0];
+            corners[3] = corners[1];
+            break;
+
+        case SDYN_NODE_MUL:
+            overflow |= __builtin_mul_overflow(lmin, rmin, &corners[0]);
+            overflow |= __builtin_mul_overflow(lmin, rmax, &corners[1]);
+            overflow |= __builtin_mul_overflow(lmax, rmin, &corners[2]);
+            overflow |= __builtin_mul_overflow(lmax, rmax, &corners[3]);
+            break;
+
+        case SDYN_NODE_DIV:
+            /* truncating division is monotonic in each operand, so long as the
+             * divisor doesn't cross zero */
+            if ((rmin <= 0 && rmax >= 0) || (lmin == LONG_MIN && rmin <= -1 && rmax >= -1)) {
+                overflow = 1;
+                break;
+            }
+            corners[0] = lmin / rmin;
+            corners[1] = lmin / rmax;
+            corners[2] = lmax / rmin;
+            corners[3] = lmax / rmax;
+            break;
+
+        case SDYN_NODE_MOD:
+            /* the result has the sign of the dividend, and is smaller than the
+             * divisor */
+            if (rmin <= 0) {
+                overflow = 1;
+                break;
+            }
+            corners[0] = (lmin < 0) ? ((lmin > -(rmax - 1)) ? lmin : -(rmax - 1)) : 0;
+            corners[1] = (lmax > 0) ? ((lmax < rmax - 1) ? lmax : rmax - 1) : 0;
+            corners[2] = corners[0];
+            corners[3] = corners[1];
+            break;
+
+        default:
+            overflow = 1;
+    }
+
+    if (overflow) {
+        *min = LONG_MIN;
+        *max = LONG_MAX;
+        return;
+    }
+
+    *min = *max = corners[0];
+    for (ci = 1; ci < 4; ci++) {
+        if (corners[ci] < *min) *min = corners[ci];
+        if (corners[ci] > *max) *max = corners[ci];
+    }
 }
 
-/* compile a function to IR */
-SDyn_IRNodeArray sdyn_irCompilePrime(SDyn_Node func)
+/* find the range of values of each integer node, so that the JIT can choose
+ * cheaper arithmetic. Like types, ranges start optimistic (empty) and grow
+ * as values are unified. A unification root which keeps growing is in a loop,
+ * so is widened to the extremes rather than iterated to a fixpoint. */
+#define RANGE_WIDEN_AFTER 3
+static void irRanges(struct SDyn_IR *ir)
 {
-    SDyn_IRNodeList ir = NULL;
-    SDyn_IRNodeArray ret = NULL;
-    SDyn_IndexMap symbols = NULL;
+    struct Worklist *wl;
+    unsigned char *growth;
+    long lmin, lmax, rmin, rmax, min, max;
+    size_t i, j;
+
+    ir->rangeMin = sdyn_arenaAlloc(ir->arena, ir->length * sizeof(long));
+    ir->rangeMax = sdyn_arenaAlloc(ir->arena, ir->length * sizeof(long));
+    growth = sdyn_arenaAlloc(ir->arena, ir->length);
+    for (i = 0; i < ir->length; i++) {
+        if (SDYN_TYPE_INTEGRAL(ir->rtype[i])) {
+            ir->rangeMin[i] = LONG_MAX;
+            ir->rangeMax[i] = LONG_MIN;
+        } else {
+            ir->rangeMin[i] = LONG_MIN;
+            ir->rangeMax[i] = LONG_MAX;
+        }
+    }
+
+    wl = workNew(ir);
+    while (wl->count) {
+        i = workPop(ir, wl);
+        if (!SDYN_TYPE_INTEGRAL(ir->rtype[i])) continue;
+
+        switch (ir->op[i]) {
+            case SDYN_NODE_NUM:
+                min = max = ir->imm[i];
+                break;
+
+            case SDYN_NODE_ASSIGN:
+                irOperandRange(ir, ir->left[i], &min, &max);
+                break;
+
+            case SDYN_NODE_ASSIGNMEMBER:
+                irOperandRange(ir, ir->right[i], &min, &max);
+                break;
 
-    GGC_PUSH_4(func, ir, ret, symbols);
+            case SDYN_NODE_ASSIGNINDEX:
+                irOperandRange(ir, ir->third[i], &min, &max);
+                break;
+
+            case SDYN_NODE_ADD:
+            case SDYN_NODE_SUB:
+            case SDYN_NODE_MUL:
+            case SDYN_NODE_DIV:
+            case SDYN_NODE_MOD:
+                irOperandRange(ir, ir->left[i], &lmin, &lmax);
+                irOperandRange(ir, ir->right[i], &rmin, &rmax);
+                if (lmin > lmax || rmin > rmax) {
+                    /* an operand isn't known yet */
+                    min = LONG_MAX;
+                    max = LONG_MIN;
+                } else {
+                    irArithRange(ir->op[i], lmin, lmax, rmin, rmax, &min, &max);
+                }
+                break;
+
+            case SDYN_NODE_UNIFY:
+                if (ir->uidx[i] != i) {
+                    min = ir->rangeMin[ir->uidx[i]];
+                    max = ir->rangeMax[ir->uidx[i]];
+                    break;
+                }
+
+                /* the union of everything unified into it. Ranges only grow,
+                 * so include what we already had */
+                min = ir->rangeMin[i];
+                max = ir->rangeMax[i];
+                for (j = ir->membersStart[i]; j < ir->membersStart[i + 1]; j++) {
+                    lmin = ir->rangeMin[ir->members[j]];
+                    lmax = ir->rangeMax[ir->members[j]];
+                    if (lmin < min) min = lmin;
+                    if (lmax > max) max = lmax;
+                }
+
+                /* don't chase a growing loop variable forever */
+                if (min <= max && growth[i] >= RANGE_WIDEN_AFTER) {
+                    if (min < ir->rangeMin[i]) min = LONG_MIN;
+                    if (max > ir->rangeMax[i]) max = LONG_MAX;
+                }
+                break;
+
+            default:
+                min = LONG_MIN;
+                max = LONG_MAX;
+        }
+
+        if (min != ir->rangeMin[i] || max != ir->rangeMax[i]) {
+            ir->rangeMin[i] = min;
+            ir->rangeMax[i] = max;
+            if (growth[i] < RANGE_WIDEN_AFTER) growth[i]++;
+            workUsers(ir, wl, i);
+        }
+    }
+
+    /* anything still empty is never computed, but make it sane anyway */
+    for (i = 0; i < ir->length; i++) {
+        if (ir->rangeMin[i] > ir->rangeMax[i]) {
+            ir->rangeMin[i] = LONG_MIN;
+            ir->rangeMax[i] = LONG_MAX;
+        }
+    }
+}
+#undef RANGE_WIDEN_AFTER
+
+/* compile a function to IR, specialized to the given argument types if
+ * argTypes isn't NULL */
+struct SDyn_IR *sdyn_irCompilePrime(struct SDyn_Arena *arena, struct SDyn_Node *func, const int *argTypes)
+{
+    struct SDyn_IR *ir;
+    struct SymbolTable *symbols;
 
     /* compile it */
-    ir = GGC_NEW(SDyn_IRNodeList);
-    symbols = GGC_NEW(SDyn_IndexMap);
+    ir = sdyn_arenaAlloc(arena, sizeof(struct SDyn_IR));
+    ir->arena = arena;
+    ir->argTypes = argTypes;
+    symbols = newSymbolTable(arena);
     irCompileNode(ir, func, symbols, NULL);
 
-    /* convert to array */
-    ret = SDyn_IRNodeListToArray(ir);
-
     /* do type propagation */
-    irUidx(ret);
-    irFlowTypes(ret);
+    irUidx(ir);
+    irScalarReplace(ir);
+    irDependencies(ir);
+    irFlowTypes(ir);
+    irRanges(ir);
+
+    /* and find the control flow */
+    ir->cfg = sdyn_irBuildCFG(ir);
+
+    return ir;
+}
+
+/* a pool of stack slots for the register allocator. Freed slots are kept on
+ * a free list, so allocation never has to search for one */
+struct SlotPool {
+    char *used; /* which slots are in use */
+    size_t *free; /* the free list */
+    size_t freeCount;
+    size_t count; /* how many slots have ever been used */
+};
+
+static struct SlotPool *slotPoolNew(struct SDyn_Arena *arena, size_t max)
+{
+    struct SlotPool *ret = sdyn_arenaAlloc(arena, sizeof(struct SlotPool));
+    ret->used = sdyn_arenaAlloc(arena, max);
+    ret->free = sdyn_arenaAlloc(arena, max * sizeof(size_t));
+    return ret;
+}
 
+static size_t slotAlloc(struct SlotPool *pool)
+{
+    size_t ret;
+    if (pool->freeCount)
+        ret = pool->free[--pool->freeCount];
+    else
+        ret = pool->count++;
+    pool->used[ret] = 1;
     return ret;
 }
 
+static void slotFree(struct SlotPool *pool, size_t slot)
+{
+    /* a slot may be released by several last uses, but must only be freed once */
+    if (pool->used[slot]) {
+        pool->used[slot] = 0;
+        pool->free[pool->freeCount++] = slot;
+    }
+}
+
 /* perform register allocation on an IR */
-void sdyn_irRegAlloc(SDyn_IRNodeArray ir, struct SDyn_RegisterMap *registerMap)
+void sdyn_irRegAlloc(struct SDyn_IR *ir, struct SDyn_RegisterMap *registerMap)
 {
-    SDyn_IRNode node = NULL, unode = NULL, callNode = NULL;
-    GGC_char_Array stksUsed = NULL, pstksUsed = NULL, irUsed = NULL;
-    GGC_size_t_Array lastUsed = NULL;
+    struct SlotPool *stks, *pstks;
+    char *irUsed;
+    size_t **lastUseds, *lastUsedCounts, *lastUsed;
     int last[4];
-    int li, tmpi;
-    size_t i, idx, stkUsed, pstkUsed, astkUsed;
+    int li;
+    size_t i, idx, uidx, callNode, stkUsed, pstkUsed, astkUsed;
     long si;
 
-    GGC_PUSH_8(ir, node, unode, callNode, stksUsed, pstksUsed, irUsed, lastUsed);
+    callNode = 0;
 
 #define USED(v) do { \
     size_t vv = (v); \
-    unode = GGC_RAP(ir, vv); \
-    idx = GGC_RD(unode, uidx); \
-    if (vv && !GGC_RAD(irUsed, idx)) { \
+    idx = ir->uidx[vv]; \
+    if (vv && !irUsed[idx]) { \
         /* it's used here and wasn't already used, so this must be the last use */ \
         last[li++] = vv; \
-        GGC_WAD(irUsed, idx, 1); \
+        irUsed[idx] = 1; \
     } \
 } while(0)
 
-    irUsed = GGC_NEW_DA(char, ir->length);
+    irUsed = sdyn_arenaAlloc(ir->arena, ir->length);
+
+    /* values used no later than each node are only needed here, so keep them
+     * in side tables */
+    lastUseds = sdyn_arenaAlloc(ir->arena, ir->length * sizeof(size_t *));
+    lastUsedCounts = sdyn_arenaAlloc(ir->arena, ir->length * sizeof(size_t));
 
     /* then perform last-use analysis */
     for (si = ir->length - 1; si >= 0; si--) {
-        node = GGC_RAP(ir, si);
-
         li = 0;
-        USED(GGC_RD(node, uidx));
-        USED(GGC_RD(node, left));
-        USED(GGC_RD(node, right));
-        USED(GGC_RD(node, third));
+        USED(ir->uidx[si]);
+        USED(ir->left[si]);
+        USED(ir->right[si]);
+        USED(ir->third[si]);
 
         /* handle special cases */
-        switch (GGC_RD(node, op)) {
+        switch (ir->op[si]) {
             case SDYN_NODE_CALL:
+            case SDYN_NODE_CALLMEMBER:
             case SDYN_NODE_INTRINSICCALL:
                 /* calls need to associate all their args, but to do that, we'll need to wait 'til the last arg */
-                callNode = node;
+                callNode = si;
                 break;
 
             case SDYN_NODE_ARG:
                 /* an argument for a call. If callNode isn't set, this is a mistake! */
                 if (callNode) {
-                    lastUsed = GGC_RP(callNode, lastUsed);
+                    lastUsed = lastUseds[callNode];
                     if (!lastUsed) {
                         /* it doesn't have a lastUsed yet, so we must be the last argument */
-                        lastUsed = GGC_NEW_DA(size_t, GGC_RD(node, imm) + 3);
-                        GGC_WP(callNode, lastUsed, lastUsed);
+                        lastUsedCounts[callNode] = ir->imm[si] + 3;
+                        lastUsed = lastUseds[callNode] =
+                            sdyn_arenaAlloc(ir->arena, lastUsedCounts[callNode] * sizeof(size_t));
 
                         /* set the call's dependencies */
-                        idx = GGC_RD(callNode, uidx);
-                        GGC_WAD(lastUsed, 0, idx);
-                        if (GGC_RD(callNode, op) == SDYN_NODE_CALL) {
+                        lastUsed[0] = ir->uidx[callNode];
+                        if (ir->op[callNode] != SDYN_NODE_INTRINSICCALL) {
                             /* it also has a left */
-                            unode = GGC_RAP(ir, GGC_RD(callNode, left));
-                            idx = GGC_RD(unode, uidx);
-                            GGC_WAD(lastUsed, 1, idx);
+                            lastUsed[1] = ir->uidx[ir->left[callNode]];
                         }
 
-                        idx = GGC_RD(node, uidx);
+                        idx = ir->uidx[si];
                     }
 
                     /* add ourself to the last used of the call */
-                    GGC_WAD(lastUsed, GGC_RD(node, imm) + 2, idx);
+                    lastUsed[ir->imm[si] + 2] = idx;
                 }
                 /* no break */
 
             default:
                 if (li) {
                     /* set its lastUsed */
-                    lastUsed = GGC_NEW_DA(size_t, li);
-                    for (li--; li >= 0; li--) {
-                        tmpi = last[li];
-                        GGC_WAD(lastUsed, li, tmpi);
-                    }
-                    GGC_WP(node, lastUsed, lastUsed);
+                    lastUsedCounts[si] = li;
+                    lastUseds[si] = sdyn_arenaAlloc(ir->arena, li * sizeof(size_t));
+                    for (li--; li >= 0; li--)
+                        lastUseds[si][li] = last[li];
                 }
         }
     }
@@ -1022,110 +2049,82 @@ void sdyn_irRegAlloc(SDyn_IRNodeArray ir, struct SDyn_RegisterMap *registerMap)
 #undef USED
 
     /* now do simple "register" assignment */
-    stksUsed = GGC_NEW_DA(char, ir->length);
-    pstksUsed = GGC_NEW_DA(char, ir->length);
-    stkUsed = pstkUsed = astkUsed = 0;
+    stks = slotPoolNew(ir->arena, ir->length);
+    pstks = slotPoolNew(ir->arena, ir->length);
+    astkUsed = 0;
     for (si = 0; si < ir->length; si++) {
         int stype = 0;
         size_t addr = 0;
-        GGC_char_Array *cstksUsed;
-        size_t *cstkUsed;
-
-        node = GGC_RAP(ir, si);
-        idx = GGC_RD(node, uidx);
-        unode = GGC_RAP(ir, idx);
-        while (GGC_RD(unode, uidx) != idx) {
-            idx = GGC_RD(unode, uidx);
-            unode = GGC_RAP(ir, idx);
-        }
+        struct SlotPool *cstks;
+
+        uidx = ir->uidx[si];
 
         /* special cases */
-        if (GGC_RD(node, op) == SDYN_NODE_ARG) {
+        if (ir->op[si] == SDYN_NODE_ARG) {
             stype = SDYN_STORAGE_ASTK;
-            addr = GGC_RD(node, imm);
+            addr = ir->imm[si];
             if (addr >= astkUsed) astkUsed = addr + 1;
-            GGC_WD(node, stype, stype);
-            GGC_WD(node, addr, addr);
-            GGC_WD(unode, stype, stype);
-            GGC_WD(unode, addr, addr);
+            ir->stype[si] = ir->stype[uidx] = stype;
+            ir->addr[si] = ir->addr[uidx] = addr;
             continue;
         }
 
         /* does this even need a register? */
-        if (GGC_RD(node, rtype) == SDYN_TYPE_NIL) continue;
+        if (ir->rtype[si] == SDYN_TYPE_NIL) continue;
 
         /* has it already been assigned? */
-        if (GGC_RD(unode, stype)) {
-            stype = GGC_RD(unode, stype);
-            addr = GGC_RD(unode, addr);
-            GGC_WD(node, stype, stype);
-            GGC_WD(node, addr, addr);
+        if (ir->stype[uidx]) {
+            ir->stype[si] = ir->stype[uidx];
+            ir->addr[si] = ir->addr[uidx];
             continue;
         }
 
         /* does it need to go on the pointer stack? */
-        if (GGC_RD(unode, rtype) >= SDYN_TYPE_FIRST_BOXED) {
+        if (ir->rtype[uidx] >= SDYN_TYPE_FIRST_BOXED) {
             stype = SDYN_STORAGE_PSTK;
-            cstksUsed = &pstksUsed;
-            cstkUsed = &pstkUsed;
+            cstks = pstks;
         } else {
             stype = SDYN_STORAGE_STK;
-            cstksUsed = &stksUsed;
-            cstkUsed = &stkUsed;
-        }
-
-        /* find the first free memory address */
-        for (i = 0; i < (*cstksUsed)->length; i++) {
-            if (!GGC_RAD((*cstksUsed), i)) break;
+            cstks = stks;
         }
 
         /* assign it */
-        GGC_WD(node, stype, stype);
-        GGC_WD(node, addr, i);
-        GGC_WD(unode, stype, stype);
-        GGC_WD(unode, addr, i);
-        if (i >= *cstkUsed) *cstkUsed = i + 1;
-        if (cstksUsed == &pstksUsed)
-            GGC_WAD(pstksUsed, i, 1);
-        else
-            GGC_WAD(stksUsed, i, 1);
+        addr = slotAlloc(cstks);
+        ir->stype[si] = ir->stype[uidx] = stype;
+        ir->addr[si] = ir->addr[uidx] = addr;
 
         /* and remove any that are no longer used */
-        lastUsed = GGC_RP(node, lastUsed);
-        if (lastUsed) {
-            for (i = 0; i < lastUsed->length; i++) {
-                unode = GGC_RAP(ir, GGC_RAD(lastUsed, i));
-                stype = GGC_RD(unode, stype);
-                addr = GGC_RD(unode, addr);
-                if (stype == SDYN_STORAGE_PSTK) {
-                    GGC_WAD(pstksUsed, addr, 0);
-                } else if (stype == SDYN_STORAGE_STK) {
-                    GGC_WAD(stksUsed, addr, 0);
-                }
+        lastUsed = lastUseds[si];
+        for (i = 0; i < lastUsedCounts[si]; i++) {
+            idx = lastUsed[i];
+            stype = ir->stype[idx];
+            addr = ir->addr[idx];
+            if (stype == SDYN_STORAGE_PSTK) {
+                slotFree(pstks, addr);
+            } else if (stype == SDYN_STORAGE_STK) {
+                slotFree(stks, addr);
             }
         }
     }
+    stkUsed = stks->count;
+    pstkUsed = pstks->count;
 
     /* now go through and fix up the stack addresses, allocas and popas to account for the argument stack */
     if (astkUsed < 2) astkUsed = 2; /* always allocate some play space for pointers */
     pstkUsed += astkUsed;
     for (si = 0; si < ir->length; si++) {
-        size_t addr = 0;
-        node = GGC_RAP(ir, si);
-        if (GGC_RD(node, stype) == SDYN_STORAGE_PSTK) {
-            addr = GGC_RD(node, addr) + astkUsed;
-            GGC_WD(node, addr, addr);
-        }
+        if (ir->stype[si] == SDYN_STORAGE_PSTK)
+            ir->addr[si] += astkUsed;
 
-        switch (GGC_RD(node, op)) {
+        switch (ir->op[si]) {
             case SDYN_NODE_ALLOCA:
             case SDYN_NODE_POPA:
-                GGC_WD(node, imm, stkUsed);
+                ir->imm[si] = stkUsed;
                 break;
 
             case SDYN_NODE_PALLOCA:
             case SDYN_NODE_PPOPA:
-                GGC_WD(node, imm, pstkUsed);
+                ir->imm[si] = pstkUsed;
                 break;
         }
     }
@@ -1134,13 +2133,11 @@ void sdyn_irRegAlloc(SDyn_IRNodeArray ir, struct SDyn_RegisterMap *registerMap)
 }
 
 /* compile and perform register allocation */
-SDyn_IRNodeArray sdyn_irCompile(SDyn_Node func, struct SDyn_RegisterMap *registerMap)
+struct SDyn_IR *sdyn_irCompile(struct SDyn_Arena *arena, struct SDyn_Node *func, const int *argTypes, struct SDyn_RegisterMap *registerMap)
 {
-    SDyn_IRNodeArray ret = NULL;
-
-    GGC_PUSH_2(func, ret);
+    struct SDyn_IR *ret;
 
-    ret = sdyn_irCompilePrime(func);
+    ret = sdyn_irCompilePrime(arena, func, argTypes);
     sdyn_irRegAlloc(ret, registerMap);
 
     return ret;
@@ -1149,55 +2146,46 @@ SDyn_IRNodeArray sdyn_irCompile(SDyn_Node func, struct SDyn_RegisterMap *registe
 #ifdef USE_SDYN_IR_TEST
 #include "sja/buffer.h"
 
-static void dumpIR(SDyn_IRNodeArray ir)
+static void dumpIR(struct SDyn_IR *ir)
 {
-    SDyn_IRNode node = NULL;
-    SDyn_String string = NULL;
-    SDyn_Tag tag = NULL;
-    GGC_char_Array arr = NULL, yes = NULL, na = NULL;
-    size_t i;
-    char c;
-
-    GGC_PUSH_7(ir, node, string, tag, arr, yes, na);
-
-    yes = GGC_NEW_DA(char, 1);
-    c = '+';
-    GGC_WAD(yes, 0, c);
-    na = GGC_NEW_DA(char, 1);
-    c = '-';
-    GGC_WAD(na, 0, c);
+    struct SDyn_IRBlock *block;
+    const unsigned char *str;
+    size_t i, strLen;
 
     for (i = 0; i < ir->length; i++) {
-        node = GGC_RAP(ir, i);
-
-        /* try to get out the immp value */
-        string = (SDyn_String) GGC_RP(node, immp);
-        arr = na;
-        if (string) {
-            arr = yes;
-            tag = (SDyn_Tag) GGC_RUP(string);
-            if (tag && GGC_RD(tag, type) == SDYN_TYPE_STRING)
-                arr = GGC_RP(string, value);
+        /* mark the beginning of each block */
+        block = &ir->cfg->blocks[ir->cfg->nodeBlock[i]];
+        if (block->start == i) {
+            printf(" block %lu:%s idom:%ld loop:%ld:%d\n",
+                    (unsigned long) ir->cfg->nodeBlock[i],
+                    block->reachable ? "" : " (unreachable)",
+                    (long) block->idom, (long) block->loopHeader, block->loopDepth);
         }
 
-        /* and print it */
-        printf("  %lu:\r\t %s\r\t\t\t t:%d\r\t\t\t\t s:%d:%lu\r\t\t\t\t\t i:%lu:%.*s\r\t\t\t\t\t\t\t o:%lu:%lu\n",
+        str = sdyn_irString(ir, i, &strLen);
+        if (!str) {
+            str = (const unsigned char *) "-";
+            strLen = 1;
+        }
+
+        printf("  %lu:\r\t %s\r\t\t\t t:%d\r\t\t\t\t s:%d:%lu\r\t\t\t\t\t i:%lu:%.*s\r\t\t\t\t\t\t\t o:%lu:%lu",
                 (unsigned long) i,
-                sdyn_nodeNames[GGC_RD(node, op)],
-                GGC_RD(node, rtype),
-                GGC_RD(node, stype), (unsigned long) GGC_RD(node, addr),
-                (unsigned long) GGC_RD(node, imm), (int) arr->length, arr->a__data,
-                (unsigned long) GGC_RD(node, left), (unsigned long) GGC_RD(node, right));
+                sdyn_nodeNames[ir->op[i]],
+                ir->rtype[i],
+                ir->stype[i], (unsigned long) ir->addr[i],
+                (unsigned long) ir->imm[i], (int) strLen, (char *) str,
+                (unsigned long) ir->left[i], (unsigned long) ir->right[i]);
+        if (ir->rangeMin[i] != LONG_MIN || ir->rangeMax[i] != LONG_MAX)
+            printf("\r\t\t\t\t\t\t\t\t\t r:%ld:%ld", ir->rangeMin[i], ir->rangeMax[i]);
+        printf("\n");
     }
-
-    return;
 }
 
 int main()
 {
-    SDyn_Node pnode = NULL, cnode = NULL;
-    SDyn_NodeArray children = NULL;
-    SDyn_IRNodeArray ir = NULL;
+    struct SDyn_Arena arena;
+    struct SDyn_Node *pnode, *cnode;
+    struct SDyn_IR *ir;
     size_t i;
     struct Buffer_char buf;
     const unsigned char *cur;
@@ -1208,23 +2196,22 @@ int main()
     cur = (unsigned char *) buf.buf;
 
     sdyn_initValues();
+    sdyn_arenaInit(&arena);
 
-    GGC_PUSH_4(pnode, cnode, children, ir);
-
-    pnode = sdyn_parse(cur);
-    children = GGC_RP(pnode, children);
+    pnode = sdyn_parse(&arena, cur);
 
-    for (i = 0; i < children->length; i++) {
-        cnode = GGC_RAP(children, i);
-        if (GGC_RD(cnode, type) == SDYN_NODE_FUNDECL) {
-            printf("%.*s:\n",
-                (int) GGC_RD(cnode, tok).valLen, (char *) GGC_RD(cnode, tok).val);
+    for (i = 0; i < pnode->children->length; i++) {
+        cnode = pnode->children->a[i];
+        if (cnode->type == SDYN_NODE_FUNDECL) {
+            printf("%.*s:\n", (int) cnode->tok.valLen, (char *) cnode->tok.val);
 
-            ir = sdyn_irCompile(cnode, NULL);
+            ir = sdyn_irCompile(&arena, cnode, NULL, NULL);
             dumpIR(ir);
         }
     }
 
+    sdyn_arenaFree(&arena);
+
     return 0;
 }
 #endif
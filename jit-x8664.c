@@ -21,35 +21,56 @@
  *
  *  By the Unix calling convention, the first four arguments go in RDI, RSI,
  *  RDX, RCX, the return goes in RAX, RSP is the stack pointer and RBP is the
- *  frame pointer. We use ONLY these registers. RSP must be 16-byte aligned.
+ *  frame pointer, and RBX, RBP and R12-R15 are preserved across calls. We use
+ *  ONLY these registers, R14 and R15 (below) and R8. RSP must be 16-byte
+ *  aligned.
  *
- *  RDI is used as the second (collected pointer) stack. RDI will never be
- *  overwritten by a JIT function, but MAY be overwritten by a normal function,
- *  so calls to normal functions must save RDI on the conventional stack (RSP)
- *  and restore it. All functions are guaranteed to preserve RSP and RBP.
+ *  R15 is used as the second (collected pointer) stack, and R14 points to
+ *  sdyn_globals, so undefined, true, false and the global object are each one
+ *  load away. Both are callee-saved, so nothing need save them around calls.
  *  Normal functions intended to be called by the JIT take the pointer stack as
  *  their first argument, and so the JIT is never responsible for communicating
- *  it to the GC.
+ *  it to the GC. JIT code calls them through a trampoline per function, which
+ *  moves R15 to RDI and jumps to the function, and is allocated close enough
+ *  to the code to be reached with a CALL rel32 (see struct CodeChunk).
  *
  *  JIT functions themselves take RDI as the pointer stack, RSI as the number
  *  of arguments, and RDX as the argument array. All arguments must be boxed,
  *  and thus RDX is frequently (but not necessarily) a region within the
- *  pointer stack as well. If RSI is 0, RDX may be 0. JIT functions must
- *  restore RDI to its former value before returning to the caller.
+ *  pointer stack as well. If RSI is 0, RDX may be 0. JIT functions save R15
+ *  and R14 just under RBP, pin RDI in R15 and sdyn_globals in R14, and
+ *  restore both before returning to the caller.
+ *
+ *  Functions with at most SDYN_FAST_ARGS parameters (including "this") also
+ *  have a fast entry point, which takes RDI as the pointer stack and the
+ *  (boxed) arguments in RSI, RDX and RCX, in that order. It must be given at
+ *  least as many arguments as the function has parameters. Call sites use
+ *  fast entry points through a call cache (see SDYN_NODE_CALL and
+ *  SDYN_NODE_CALLMEMBER), and pass the cache to sdyn_callCached or
+ *  sdyn_callMethod in R8. A tail call through a call cache pops the caller's
+ *  frames and restores its R15 and R14 before jumping to the fast entry point,
+ *  so the callee returns directly to the caller's caller.
+ *
+ *  Slow paths, such as call cache misses and coercions of values whose types
+ *  aren't known statically, are compiled out of line, after the function's
+ *  epilogue. The hot code only jumps to them in the uncommon case, and they
+ *  jump back when done, so they share the hot code's frame and registers.
  *
  *  When a JIT function initializes, its conventional stack space is not
- *  initialized (i.e., it's garbage), but its pointer stack space must be, and
- *  is initialized to many pointers to sdyn_undefined.
+ *  initialized (i.e., it's garbage), but its pointer stack space must be by
+ *  its first call out, at which the collector may run. Words the function
+ *  doesn't write before then are initialized to sdyn_undefined (see
+ *  pstackInits).
  *
- *  0(RDI) and 8(RDI) are reserved for temporary collected pointer use.
- *  -16(RBP) and -8(RBP) are reserved for temporary non-collected or
- *  non-pointer use. -8(RBP) is generally used to store RDI during calls to
- *  non-JIT functions, and should be avoided in other cases so there is no
- *  accidental overlap. Arguments begin at 16(RDI), and storage begins at
- *  16+x(RDI), where x is the maximum number of arguments times the word size
+ *  0(R15) and 8(R15) are reserved for temporary collected pointer use.
+ *  -32(RBP) and -24(RBP) are reserved for temporary non-collected or
+ *  non-pointer use. Arguments begin at 16(R15), and storage begins at
+ *  16+x(R15), where x is the maximum number of arguments times the word size
  *  (8).
  */
 
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -62,6 +83,260 @@
 
 BUFFER(size_t, size_t);
 
+/* slow paths are moved out of line, so the hot code stays dense. Each is a
+ * stub of cold code, compiled into a separate buffer and placed after the
+ * function body, which hot code jumps into and which jumps back when done */
+struct ColdStub {
+    size_t start, end; /* the stub's code in the cold buffer */
+    size_t resume; /* where in the hot code to return to */
+};
+BUFFER(ColdStub, struct ColdStub);
+
+/* offsets of data and pointer members within GC'd objects, of the length of
+ * GC'd arrays, and of the elements of pointer arrays, for inline accesses */
+#define DOFFSET(type, member)   ((size_t) (void *) &GGC_RD(((type) 0), member))
+#define POFFSET(type, member)   ((size_t) (void *) &GGC_RP(((type) 0), member))
+#define LENOFFSET               ((size_t) (void *) &(((GGC_char_Array) 0)->length))
+#define PAOFFSET                ((size_t) (void *) &(((SDyn_UndefinedArray) 0)->a__ptrs[0]))
+
+/* offsets of a GGGGC pool's generation and card table, for the inline write
+ * barrier (see GGC_WP) */
+#define POOLGENOFFSET           offsetof(struct GGGGC_Pool, gen)
+#define POOLREMEMBEROFFSET      offsetof(struct GGGGC_Pool, remember)
+
+/* runs of at least this many pointer stack words are initialized with a string
+ * store instead of one MOV each */
+#define PSTACK_STOS_MIN         8
+
+/* one of the globals, through the pinned pointer to them */
+#define GLOBAL(member)          MEM(8, R14, 0, RNONE, offsetof(struct SDyn_Globals, member))
+
+/* macros to write pseudo-assembly lines:
+ * Cn(opcode, operands) for n-ary assembly instructions
+ * CF(opcode, label) for forwards-referencing jumps
+ * L(label) to define the label for CF jumps
+ * IMM64 to load an immediate value of type size_t
+ * IMM64P to load an immediate pointer value
+ * All write to the buffer code through the peephole window peep, both of which
+ * must be in scope. */
+#define C3(x, o1, o2, o3)   peepCompile(&peep, code, OP3(x, o1, o2, o3), NULL)
+#define C2(x, o1, o2)       peepCompile(&peep, code, OP2(x, o1, o2), NULL)
+#define C1(x, o1)           peepCompile(&peep, code, OP1(x, o1), NULL)
+#define C0(x)               peepCompile(&peep, code, OP0(x), NULL)
+#define CF(x, frel)         peepCompile(&peep, code, OP0(x), &(frel))
+#define IMM64(o1, v) do { \
+    size_t imm64 = (v); \
+    if (imm64 < 0x100000000L) { \
+        C2(MOV, o1, IMM(imm64)); \
+    } else if (imm64 & 0x80000000L) { \
+        C2(MOV, o1, IMM((~imm64)>>32)); \
+        C2(SHL, o1, IMM(32)); \
+        C2(XOR, o1, IMM(imm64&0xFFFFFFFFL)); \
+    } else { \
+        C2(MOV, o1, IMM(imm64>>32)); \
+        C2(SHL, o1, IMM(32)); \
+        C2(OR, o1, IMM(imm64&0xFFFFFFFFL)); \
+    } \
+} while(0)
+#define IMM64P(o1, v) IMM64(o1, (size_t) (void *) (v))
+#define L(frel)             peepLabel(&peep, code, (frel))
+
+/* The peephole optimizer. SJA encodes each instruction as it's written and
+ * patches labels in place, so rather than buffering a list of instructions,
+ * we keep a window on the last one encoded and rewrite the end of the buffer
+ * as each new one arrives. It works on the x86 encoding itself:
+ *  MOV r, r is dropped.
+ *  MOV r, [m] just after MOV [m], r is dropped, and MOV s, [m] becomes MOV s, r.
+ *  MOV [m], r just after MOV r, [m] is dropped, if m doesn't depend on r.
+ *  Immediates which fit in 32 unsigned bits use the short, zero-extending MOV,
+ *  and loading the same immediate twice in a row is dropped.
+ *  A jump to the very next instruction is dropped when its label is placed.
+ * Anything which makes the current position a jump target must end the window
+ * with PEEP_BARRIER(). Writing bytes to the buffer directly ends it too. */
+struct Peephole {
+    struct Buffer_uchar *buf; /* the buffer the window is in, or NULL */
+    size_t start, end; /* the last instruction */
+    int jump; /* was it a forward jump? */
+    size_t frel; /* and if so, its label */
+};
+
+#define PEEP_BARRIER() (peep.buf = NULL)
+
+/* is this a 64-bit MOV between a register and r/m, with this opcode? */
+static int peepIsMov(unsigned char *ins, size_t len, unsigned char opcode)
+{
+    return len >= 3 && (ins[0] & 0xF8) == 0x48 && ins[1] == opcode;
+}
+
+/* the register and r/m register of such a MOV */
+#define PEEP_REG(ins)   ((((ins)[0] & 4) << 1) | (((ins)[2] >> 3) & 7))
+#define PEEP_RM(ins)    ((((ins)[0] & 1) << 3) | ((ins)[2] & 7))
+
+/* is its r/m operand a (non-RIP-relative) memory operand? */
+static int peepIsMem(unsigned char *ins)
+{
+    unsigned char mod = ins[2] >> 6, rm = ins[2] & 7;
+    return mod != 3 && !(mod == 0 && rm == 5);
+}
+
+/* do these two MOVs have the same memory operand? */
+static int peepSameMem(unsigned char *a, size_t aLen, unsigned char *b, size_t bLen)
+{
+    return aLen == bLen &&
+           (a[0] & 3) == (b[0] & 3) &&
+           (a[2] & 0xC7) == (b[2] & 0xC7) &&
+           !memcmp(a + 3, b + 3, aLen - 3);
+}
+
+/* does the address of this MOV's memory operand depend on this register? */
+static int peepAddrUses(unsigned char *ins, int reg)
+{
+    unsigned char mod = ins[2] >> 6, sib;
+    int base, index;
+
+    if ((ins[2] & 7) != 4)
+        return PEEP_RM(ins) == reg;
+
+    sib = ins[3];
+    base = ((ins[0] & 1) << 3) | (sib & 7);
+    index = ((ins[0] & 2) << 2) | ((sib >> 3) & 7);
+    if (base == reg && !(mod == 0 && (sib & 7) == 5)) return 1;
+    return index != 4 && index == reg;
+}
+
+/* is this a MOV of an immediate into a register? */
+static int peepIsMovImm(unsigned char *ins, size_t len)
+{
+    switch (len) {
+        case 5: return (ins[0] & 0xF8) == 0xB8;
+        case 6: return ins[0] == 0x41 && (ins[1] & 0xF8) == 0xB8;
+        case 7: return (ins[0] & 0xFE) == 0x48 && ins[1] == 0xC7 && (ins[2] & 0xF8) == 0xC0;
+        case 10: return (ins[0] & 0xFE) == 0x48 && (ins[1] & 0xF8) == 0xB8;
+    }
+    return 0;
+}
+
+/* compile an instruction through the peephole optimizer */
+static void peepCompile(struct Peephole *peep, struct Buffer_uchar *code,
+        struct SJA_X8664_Op op, size_t *frel)
+{
+    unsigned char *cur, *prev, imm[4];
+    size_t start, len, prevLen;
+    int reg;
+
+    start = code->bufused;
+    sja_compile(op, code, frel);
+    cur = code->buf + start;
+    len = code->bufused - start;
+
+    /* shorten immediate loads which don't need sign extension or 64 bits */
+    if (peepIsMovImm(cur, len) &&
+        ((len == 7 && !(cur[6] & 0x80)) ||
+         (len == 10 && !cur[6] && !cur[7] && !cur[8] && !cur[9]))) {
+        reg = ((cur[0] & 1) << 3) | (cur[len == 7 ? 2 : 1] & 7);
+        memcpy(imm, cur + len - (len == 7 ? 4 : 8), 4);
+        len = 0;
+        if (reg >= 8) cur[len++] = 0x41;
+        cur[len++] = 0xB8 | (reg & 7);
+        memcpy(cur + len, imm, 4);
+        len += 4;
+        code->bufused = start + len;
+    }
+
+    /* moving a register to itself does nothing */
+    if (len == 3 && (peepIsMov(cur, len, 0x89) || peepIsMov(cur, len, 0x8B)) &&
+        (cur[2] >> 6) == 3 && PEEP_REG(cur) == PEEP_RM(cur)) {
+        code->bufused = start;
+        return;
+    }
+
+    /* the rest look at the previous instruction too */
+    if (!frel && peep->buf == code && peep->end == start) {
+        prev = code->buf + peep->start;
+        prevLen = peep->end - peep->start;
+
+        if (peepIsMov(prev, prevLen, 0x89) && peepIsMov(cur, len, 0x8B) &&
+            peepIsMem(prev) && peepSameMem(prev, prevLen, cur, len)) {
+            /* a load of what we just stored */
+            reg = PEEP_REG(prev);
+            if (PEEP_REG(cur) == reg) {
+                code->bufused = start;
+                return;
+            }
+
+            /* it's still in the register we stored from */
+            cur[0] = 0x48 | ((reg & 8) >> 1) | ((PEEP_REG(cur) & 8) >> 3);
+            cur[2] = 0xC0 | ((reg & 7) << 3) | (PEEP_REG(cur) & 7);
+            cur[1] = 0x89;
+            len = 3;
+            code->bufused = start + len;
+
+        } else if (peepIsMov(prev, prevLen, 0x8B) && peepIsMov(cur, len, 0x89) &&
+                   peepIsMem(prev) && peepSameMem(prev, prevLen, cur, len) &&
+                   PEEP_REG(prev) == PEEP_REG(cur) &&
+                   !peepAddrUses(cur, PEEP_REG(cur))) {
+            /* a store of what we just loaded */
+            code->bufused = start;
+            return;
+
+        } else if (peepIsMovImm(cur, len) && prevLen == len &&
+                   !memcmp(prev, cur, len)) {
+            /* the same immediate again */
+            code->bufused = start;
+            return;
+
+        }
+    }
+
+    peep->buf = code;
+    peep->start = start;
+    peep->end = code->bufused;
+    peep->jump = !!frel;
+    peep->frel = frel ? *frel : 0;
+}
+
+/* place a label, dropping the jump to it if that was the last instruction */
+static void peepLabel(struct Peephole *peep, struct Buffer_uchar *code, size_t frel)
+{
+    if (peep->buf == code && peep->end == code->bufused &&
+        peep->jump && peep->frel == frel)
+        code->bufused = peep->start;
+    else
+        sja_patchFrel(code, frel);
+    peep->buf = NULL;
+}
+
+/* load a 64-bit immediate into a register, always in the long form (MOVABS),
+ * so it can be relocated. SJA only encodes the short forms, so we let it
+ * encode a short one and widen it. Returns the position of the immediate. Like
+ * any direct write, this ends the peephole window. */
+static size_t movAbs(struct Buffer_uchar *code, struct SJA_X8664_Operand reg, size_t imm64)
+{
+    unsigned char *ins;
+    size_t start;
+    int r;
+
+    while (BUFFER_SPACE(*code) < 10) EXPAND_BUFFER(*code);
+    start = code->bufused;
+    sja_compile(OP2(MOV, reg, IMM(0)), code, NULL);
+    ins = code->buf + start;
+    switch (code->bufused - start) {
+        case 5: r = ins[0] & 7; break;
+        case 6: r = 8 | (ins[1] & 7); break;
+        case 7: r = ((ins[0] & 1) << 3) | (ins[2] & 7); break;
+        case 10: r = ((ins[0] & 1) << 3) | (ins[1] & 7); break;
+        default:
+            fprintf(stderr, "Unexpected immediate load encoding!\n");
+            abort();
+    }
+
+    ins[0] = 0x48 | (r >> 3);
+    ins[1] = 0xB8 | (r & 7);
+    memcpy(ins + 2, &imm64, 8);
+    code->bufused = start + 10;
+    return start + 2;
+}
+
 /* utility function to create a pointer that's GC'd */
 static void **createPointer()
 {
@@ -78,115 +353,939 @@ static void **createPointer()
     return ret;
 }
 
-/* compile IR into a native function */
-sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
+/* make an empty call cache */
+static struct SDyn_CallCache *newCallCache()
+{
+    struct SDyn_CallCache *cache = malloc(sizeof(struct SDyn_CallCache));
+    if (cache == NULL) {
+        perror("malloc");
+        abort();
+    }
+    cache->source = NULL;
+    cache->fast = NULL;
+    return cache;
+}
+
+/* make an empty method cache for this member */
+static struct SDyn_MethodCache *newMethodCache(const unsigned char *member, size_t len)
+{
+    struct SDyn_MethodCache *cache = malloc(sizeof(struct SDyn_MethodCache));
+    if (cache == NULL) {
+        perror("malloc");
+        abort();
+    }
+    cache->member = (SDyn_String *) createPointer();
+    *cache->member = sdyn_internString(NULL, (char *) member, len);
+    cache->shape = (SDyn_Shape *) createPointer();
+    cache->index = 0;
+    cache->call.source = NULL;
+    cache->call.fast = NULL;
+    return cache;
+}
+
+/* make an empty member assignment cache for this member */
+static struct SDyn_MemberCache *newMemberCache(const unsigned char *member, size_t len)
+{
+    struct SDyn_MemberCache *cache = malloc(sizeof(struct SDyn_MemberCache));
+    if (cache == NULL) {
+        perror("malloc");
+        abort();
+    }
+    cache->member = (SDyn_String *) createPointer();
+    *cache->member = sdyn_internString(NULL, (char *) member, len);
+    cache->shape = (SDyn_Shape *) createPointer();
+    cache->index = 0;
+    return cache;
+}
+
+/* find the magic multiplier and shift to divide by a constant (at least 2)
+ * with a multiply, per Hacker's Delight */
+static void divMagic(long divisor, long *magic, int *shift)
+{
+    unsigned long two63 = 1UL << 63, d = divisor, anc, q1, r1, q2, r2, delta;
+    int p;
+
+    anc = two63 - 1 - two63 % d;
+    p = 63;
+    q1 = two63 / anc;
+    r1 = two63 - q1 * anc;
+    q2 = two63 / d;
+    r2 = two63 - q2 * d;
+    do {
+        p++;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc) {
+            q1++;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= d) {
+            q2++;
+            r2 -= d;
+        }
+        delta = d - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+
+    *magic = q2 + 1;
+    *shift = p - 64;
+}
+
+/* JIT code is allocated from large chunks of executable memory. Each chunk
+ * has its own trampolines to the runtime helpers its code calls, so that
+ * code can reach them with a short CALL rel32, and the trampoline passes the
+ * pointer stack to the helper */
+#define CODE_CHUNK_SIZE     (16 * 1024 * 1024)
+#define TRAMPOLINE_SIZE     32
+
+struct CodeChunk {
+    unsigned char *free, *end;
+    size_t helperCount, helperCapacity;
+    void **helpers; /* the helpers with trampolines in this chunk */
+    unsigned char **trampolines; /* and those trampolines */
+};
+static struct CodeChunk codeChunk;
+
+/* start a new code chunk with at least this much room */
+static void newCodeChunk(size_t sz)
+{
+    unsigned char *base;
+
+    if (sz < CODE_CHUNK_SIZE) sz = CODE_CHUNK_SIZE;
+    sz = (sz + 4095) / 4096 * 4096;
+    base = mmap(NULL, sz, PROT_READ|PROT_WRITE|PROT_EXEC, MAP_PRIVATE|MAP_ANON, -1, 0);
+    if (base == MAP_FAILED) {
+        perror("mmap");
+        abort();
+    }
+
+    /* the old chunk's trampolines are out of reach */
+    codeChunk.free = base;
+    codeChunk.end = base + sz;
+    codeChunk.helperCount = 0;
+}
+
+/* allocate code memory from the current chunk, which must have room */
+static unsigned char *codeAlloc(size_t sz)
+{
+    unsigned char *ret;
+    ret = (unsigned char *) (((size_t) codeChunk.free + 15) & ~((size_t) 15));
+    codeChunk.free = ret + sz;
+    return ret;
+}
+
+/* find the trampoline to this helper in the current chunk, or NULL */
+static unsigned char *findTrampoline(void *helper)
+{
+    size_t i;
+    for (i = 0; i < codeChunk.helperCount; i++)
+        if (codeChunk.helpers[i] == helper) return codeChunk.trampolines[i];
+    return NULL;
+}
+
+/* make a trampoline to this helper in the current chunk, which must have room */
+static unsigned char *makeTrampoline(void *helper)
+{
+    struct Buffer_uchar tbuf, *code = &tbuf;
+    struct Peephole peep;
+    unsigned char *ret;
+
+    INIT_BUFFER(tbuf);
+    PEEP_BARRIER();
+
+    /* the pointer stack is pinned in a callee-saved register, so we need
+     * only pass it, and can jump straight to the helper */
+    C2(MOV, RDI, R15);
+    IMM64P(RAX, helper);
+    C1(JMP, RAX);
+
+    ret = codeAlloc(TRAMPOLINE_SIZE);
+    memcpy(ret, tbuf.buf, tbuf.bufused);
+    FREE_BUFFER(tbuf);
+
+    if (codeChunk.helperCount >= codeChunk.helperCapacity) {
+        codeChunk.helperCapacity = codeChunk.helperCapacity ? codeChunk.helperCapacity * 2 : 32;
+        codeChunk.helpers = realloc(codeChunk.helpers, codeChunk.helperCapacity * sizeof(void *));
+        codeChunk.trampolines = realloc(codeChunk.trampolines, codeChunk.helperCapacity * sizeof(unsigned char *));
+        if (codeChunk.helpers == NULL || codeChunk.trampolines == NULL) {
+            perror("realloc");
+            abort();
+        }
+    }
+    codeChunk.helpers[codeChunk.helperCount] = helper;
+    codeChunk.trampolines[codeChunk.helperCount++] = ret;
+
+    return ret;
+}
+
+/* copy code into executable memory, near trampolines to the helpers it calls.
+ * calls are (position of a CALL's rel32, helper) pairs. */
+static unsigned char *placeCode(const unsigned char *code, size_t len,
+        const size_t *calls, size_t callCount)
+{
+    unsigned char *ret, *trampoline;
+    size_t j, missing;
+    int32_t rel;
+
+    missing = 0;
+    for (j = 0; j < callCount; j++)
+        if (!findTrampoline((void *) calls[j * 2 + 1])) missing++;
+    /* codeAlloc may pad by up to 15 bytes both before the code and before the
+     * first trampoline after it */
+    if ((size_t) (codeChunk.end - codeChunk.free) < len + 32 + missing * TRAMPOLINE_SIZE)
+        newCodeChunk(len + 32 + callCount * TRAMPOLINE_SIZE);
+
+    /* fill in the calls */
+    ret = codeAlloc(len);
+    memcpy(ret, code, len);
+    for (j = 0; j < callCount; j++) {
+        trampoline = findTrampoline((void *) calls[j * 2 + 1]);
+        if (!trampoline) trampoline = makeTrampoline((void *) calls[j * 2 + 1]);
+        rel = trampoline - (ret + calls[j * 2] + 4);
+        memcpy(ret + calls[j * 2], &rel, 4);
+    }
+
+    return ret;
+}
+
+/* Images. A compiled function can be saved as an image, and loaded by a later
+ * run (see snapshot.c). JIT code is position-independent except for the
+ * immediates pointing at runtime objects, such as caches and strings, and the
+ * calls to helpers through the chunk's trampolines. An image is the code with
+ * those left blank, and a relocation to fill in each. The objects are
+ * described by length-prefixed records in the image's data, and relocations to
+ * the same object share its record. An image is a sequence of words:
+ *  the length of the code, the offset of its fast entry point plus one (or 0 if
+ *  it has none), and the numbers of relocations and bytes of data,
+ *  the code, padded to a word,
+ *  each relocation, as its position in the code, kind and argument,
+ *  and the data.
+ * A relocation's argument is a helper's number for IMAGE_HELPER, and the
+ * position of its object's record in the data otherwise. */
+enum ImageReloc {
+    IMAGE_HELPER, /* CALL rel32 to a helper in imageHelpers */
+    IMAGE_GLOBALS, /* &sdyn_globals */
+    IMAGE_SELF, /* the source of the function being loaded */
+    IMAGE_FUNCTION, /* the source of the global function named by the record,
+                     * if its source is the text in the following record */
+    IMAGE_STRING, /* a GC'd pointer to the record, interned */
+    IMAGE_CALLCACHE, /* a new call cache */
+    IMAGE_METHODCACHE, /* a new method cache for the member in the record */
+    IMAGE_MEMBERCACHE, /* a new member cache for the member in the record */
+    IMAGE_RELOC_KINDS
+};
+#define IMAGE_HEADER_WORDS  4
+#define IMAGE_PAD(n)        (((n) + sizeof(size_t) - 1) / sizeof(size_t) * sizeof(size_t))
+
+/* the format of images, and of the code in them */
+const char sdyn_imageVersion[] = "sdyn x86_64 image 3";
+
+/* the runtime helpers JIT code calls, which images refer to by number */
+static void *const imageHelpers[] = {
+    (void *) sdyn_add,
+    (void *) sdyn_assertFunction,
+    (void *) sdyn_boxBool,
+    (void *) sdyn_boxInt,
+    (void *) sdyn_call,
+    (void *) sdyn_callCached,
+    (void *) sdyn_callMethod,
+    (void *) sdyn_equal,
+    (void *) sdyn_getObjectMember,
+    (void *) sdyn_iEval,
+    (void *) sdyn_intToString,
+    (void *) sdyn_iPrint,
+    (void *) sdyn_newObject,
+    (void *) sdyn_setObjectMember,
+    (void *) sdyn_setObjectMemberCached,
+    (void *) sdyn_toBoolean,
+    (void *) sdyn_toNumber,
+    (void *) sdyn_toObject,
+    (void *) sdyn_toString,
+    (void *) sdyn_typeof
+};
+#define IMAGE_HELPERS (sizeof(imageHelpers) / sizeof(void *))
+
+/* IMAGE_FUNCTION relocations whose function isn't there any more get this
+ * source instead. No function has it, so the check always fails. */
+static const unsigned char imageNoFunction[1];
+
+/* append a word to an image */
+static void imageWord(struct Buffer_uchar *image, size_t word)
+{
+    while (BUFFER_SPACE(*image) < sizeof(size_t)) EXPAND_BUFFER(*image);
+    memcpy(BUFFER_END(*image), &word, sizeof(size_t));
+    image->bufused += sizeof(size_t);
+}
+
+/* append bytes to an image, padded to a word */
+static void imageBytes(struct Buffer_uchar *image, const void *bytes, size_t len)
+{
+    while (BUFFER_SPACE(*image) < IMAGE_PAD(len)) EXPAND_BUFFER(*image);
+    if (len) memcpy(BUFFER_END(*image), bytes, len);
+    memset(BUFFER_END(*image) + len, 0, IMAGE_PAD(len) - len);
+    image->bufused += IMAGE_PAD(len);
+}
+
+/* append a record to an image's data */
+static void imageRecord(struct Buffer_uchar *data, const void *bytes, size_t len)
+{
+    imageWord(data, len);
+    imageBytes(data, bytes, len);
+}
+
+/* append a record of a string */
+static void imageString(struct Buffer_uchar *data, SDyn_String str)
+{
+    GGC_char_Array chars = NULL;
+
+    GGC_PUSH_2(str, chars);
+
+    chars = sdyn_stringValue(NULL, str);
+    imageRecord(data, chars->a__data, chars->length);
+}
+
+/* append records of the name and text of the global function with this
+ * source. Returns 0 if it's no longer that global. */
+static int imageFunction(struct Buffer_uchar *data, const unsigned char *name,
+        size_t nameLen, const unsigned char *source)
+{
+    SDyn_String gname = NULL;
+    SDyn_Undefined value = NULL;
+    SDyn_Tag tag = NULL;
+
+    GGC_PUSH_3(gname, value, tag);
+
+    gname = sdyn_internString(NULL, (char *) name, nameLen);
+    value = sdyn_getObjectMember(NULL, sdyn_globalObject, gname);
+    tag = (SDyn_Tag) GGC_RUP(value);
+    if (GGC_RD(tag, type) != SDYN_TYPE_FUNCTION ||
+        GGC_RD((SDyn_Function) value, source) != source)
+        return 0;
+
+    imageRecord(data, name, nameLen);
+    imageRecord(data, source, GGC_RD((SDyn_Function) value, sourceLen));
+    return 1;
+}
+
+/* make the image of a function from its code, before it's placed, its helper
+ * calls, and its relocations as (position, kind, value, IR node) tuples.
+ * Returns NULL if it refers to anything an image can't. */
+static unsigned char *makeImage(struct SDyn_IR *ir, struct Buffer_uchar *code,
+        size_t fast, struct Buffer_size_t *calls, struct Buffer_size_t *relocs,
+        size_t *imageLen)
+{
+    struct Buffer_uchar image, data;
+    struct Buffer_size_t rels;
+    size_t *args;
+    size_t i, j, k, kind, value, relocCount;
+    int ok;
+
+    INIT_BUFFER(image);
+    INIT_BUFFER(data);
+    INIT_BUFFER(rels);
+    ok = 1;
+
+    /* the helpers, by number */
+    for (i = 0; ok && i < calls->bufused; i += 2) {
+        for (j = 0; j < IMAGE_HELPERS && imageHelpers[j] != (void *) calls->buf[i + 1]; j++);
+        ok = (j < IMAGE_HELPERS);
+        while (BUFFER_SPACE(rels) < 3) EXPAND_BUFFER(rels);
+        rels.buf[rels.bufused++] = calls->buf[i];
+        rels.buf[rels.bufused++] = IMAGE_HELPER;
+        rels.buf[rels.bufused++] = j;
+    }
+
+    /* and the objects, by their records */
+    args = malloc(relocs->bufused / 4 * sizeof(size_t) + 1);
+    if (args == NULL) {
+        perror("malloc");
+        abort();
+    }
+    for (i = 0; ok && i < relocs->bufused; i += 4) {
+        kind = relocs->buf[i + 1];
+        value = relocs->buf[i + 2];
+        for (k = 0; k < i && (relocs->buf[k + 1] != kind || relocs->buf[k + 2] != value); k += 4);
+        if (k < i) {
+            args[i / 4] = args[k / 4];
+
+        } else {
+            args[i / 4] = data.bufused;
+            switch (kind) {
+                case IMAGE_FUNCTION:
+                    /* the IR names the function it checks for */
+                    for (j = 0; j < ir->strCount && ir->strs[j].node != relocs->buf[i + 3]; j++);
+                    ok = (j < ir->strCount) &&
+                        imageFunction(&data, ir->strs[j].str, ir->strs[j].strLen,
+                                      (const unsigned char *) value);
+                    break;
+
+                case IMAGE_STRING:
+                    imageString(&data, *((SDyn_String *) value));
+                    break;
+
+                case IMAGE_CALLCACHE:
+                    imageWord(&data, 0);
+                    break;
+
+                case IMAGE_METHODCACHE:
+                    imageString(&data, *((struct SDyn_MethodCache *) value)->member);
+                    break;
+
+                case IMAGE_MEMBERCACHE:
+                    imageString(&data, *((struct SDyn_MemberCache *) value)->member);
+                    break;
+            }
+        }
+
+        while (BUFFER_SPACE(rels) < 3) EXPAND_BUFFER(rels);
+        rels.buf[rels.bufused++] = relocs->buf[i];
+        rels.buf[rels.bufused++] = kind;
+        rels.buf[rels.bufused++] = args[i / 4];
+    }
+    free(args);
+
+    if (!ok) {
+        FREE_BUFFER(image);
+        FREE_BUFFER(data);
+        FREE_BUFFER(rels);
+        return NULL;
+    }
+
+    /* now put it all together, with the blanks blank */
+    relocCount = rels.bufused / 3;
+    imageWord(&image, code->bufused);
+    imageWord(&image, fast);
+    imageWord(&image, relocCount);
+    imageWord(&image, data.bufused);
+    i = image.bufused;
+    imageBytes(&image, code->buf, code->bufused);
+    for (j = 0; j < relocCount; j++)
+        memset(image.buf + i + rels.buf[j * 3], 0, rels.buf[j * 3 + 1] == IMAGE_HELPER ? 4 : 8);
+    for (j = 0; j < rels.bufused; j++)
+        imageWord(&image, rels.buf[j]);
+    imageBytes(&image, data.buf, data.bufused);
+
+    FREE_BUFFER(data);
+    FREE_BUFFER(rels);
+    *imageLen = image.bufused;
+    return image.buf;
+}
+
+/* read a record from an image's data. Returns 0 if it isn't all there. */
+static int imageReadRecord(const unsigned char *data, size_t dataLen, size_t at,
+        const unsigned char **bytes, size_t *len)
+{
+    if (at % sizeof(size_t) || at > dataLen || dataLen - at < sizeof(size_t))
+        return 0;
+    memcpy(len, data + at, sizeof(size_t));
+    if (*len > dataLen - at - sizeof(size_t)) return 0;
+    *bytes = data + at + sizeof(size_t);
+    return 1;
+}
+
+/* find the source for an IMAGE_FUNCTION relocation, whose records are known
+ * to be there */
+static const unsigned char *imageFunctionSource(const unsigned char *data,
+        size_t dataLen, size_t at)
+{
+    const unsigned char *name, *text, *source;
+    size_t nameLen, textLen;
+    SDyn_String gname = NULL;
+    SDyn_Undefined value = NULL;
+    SDyn_Tag tag = NULL;
+
+    GGC_PUSH_3(gname, value, tag);
+
+    imageReadRecord(data, dataLen, at, &name, &nameLen);
+    imageReadRecord(data, dataLen, at + sizeof(size_t) + IMAGE_PAD(nameLen), &text, &textLen);
+
+    /* it must be a function with the same text as when it was compiled */
+    if (!sdyn_globalObject) return imageNoFunction;
+    gname = sdyn_internString(NULL, (char *) name, nameLen);
+    value = sdyn_getObjectMember(NULL, sdyn_globalObject, gname);
+    tag = (SDyn_Tag) GGC_RUP(value);
+    if (GGC_RD(tag, type) != SDYN_TYPE_FUNCTION) return imageNoFunction;
+    source = GGC_RD((SDyn_Function) value, source);
+    if (GGC_RD((SDyn_Function) value, sourceLen) != textLen ||
+        memcmp(source, text, textLen))
+        return imageNoFunction;
+    return source;
+}
+
+/* load an image made by sdyn_compile, for the function with this source. The
+ * image must be word-aligned. Returns NULL if it's malformed. */
+sdyn_native_function_t sdyn_loadImage(const unsigned char *image, size_t len,
+        const unsigned char *source, void **fastEntry)
+{
+    const size_t *hdr, *rels;
+    const unsigned char *bytes;
+    size_t codeLen, fast, relocCount, dataLen;
+    size_t relsAt, dataAt, at, i, k, kind, arg, blen, callCount;
+    size_t *calls;
+    void **values, **root;
+    unsigned char *ret;
+
+    /* check that all the parts fit */
+    if (len < IMAGE_HEADER_WORDS * sizeof(size_t)) return NULL;
+    hdr = (const size_t *) image;
+    codeLen = hdr[0];
+    fast = hdr[1];
+    relocCount = hdr[2];
+    dataLen = hdr[3];
+    if (codeLen > len || fast > codeLen || relocCount > len || dataLen > len)
+        return NULL;
+    relsAt = IMAGE_HEADER_WORDS * sizeof(size_t) + IMAGE_PAD(codeLen);
+    dataAt = relsAt + relocCount * 3 * sizeof(size_t);
+    if (dataAt + dataLen != len) return NULL;
+    rels = (const size_t *) (image + relsAt);
+
+    for (i = 0; i < relocCount; i++) {
+        at = rels[i * 3];
+        kind = rels[i * 3 + 1];
+        arg = rels[i * 3 + 2];
+        if (kind >= IMAGE_RELOC_KINDS || at > codeLen ||
+            codeLen - at < (kind == IMAGE_HELPER ? 4 : 8))
+            return NULL;
+        switch (kind) {
+            case IMAGE_HELPER:
+                if (arg >= IMAGE_HELPERS) return NULL;
+                break;
+
+            case IMAGE_FUNCTION:
+                if (!imageReadRecord(image + dataAt, dataLen, arg, &bytes, &blen) ||
+                    !imageReadRecord(image + dataAt, dataLen,
+                        arg + sizeof(size_t) + IMAGE_PAD(blen), &bytes, &blen))
+                    return NULL;
+                break;
+
+            case IMAGE_STRING:
+            case IMAGE_CALLCACHE:
+            case IMAGE_METHODCACHE:
+            case IMAGE_MEMBERCACHE:
+                if (!imageReadRecord(image + dataAt, dataLen, arg, &bytes, &blen))
+                    return NULL;
+                break;
+        }
+    }
+
+    /* make the objects it refers to */
+    values = malloc(relocCount * sizeof(void *) + 1);
+    calls = malloc(relocCount * 2 * sizeof(size_t) + 1);
+    if (values == NULL || calls == NULL) {
+        perror("malloc");
+        abort();
+    }
+    callCount = 0;
+    for (i = 0; i < relocCount; i++) {
+        kind = rels[i * 3 + 1];
+        arg = rels[i * 3 + 2];
+        for (k = 0; k < i && (rels[k * 3 + 1] != kind || rels[k * 3 + 2] != arg); k++);
+        if (k < i) {
+            values[i] = values[k];
+
+        } else {
+            switch (kind) {
+                case IMAGE_HELPER:
+                    values[i] = imageHelpers[arg];
+                    break;
+
+                case IMAGE_GLOBALS:
+                    values[i] = &sdyn_globals;
+                    break;
+
+                case IMAGE_SELF:
+                    values[i] = (void *) source;
+                    break;
+
+                case IMAGE_FUNCTION:
+                    values[i] = (void *) imageFunctionSource(image + dataAt, dataLen, arg);
+                    break;
+
+                case IMAGE_STRING:
+                    imageReadRecord(image + dataAt, dataLen, arg, &bytes, &blen);
+                    root = createPointer();
+                    *root = sdyn_internString(NULL, (char *) bytes, blen);
+                    values[i] = root;
+                    break;
+
+                case IMAGE_CALLCACHE:
+                    values[i] = newCallCache();
+                    break;
+
+                case IMAGE_METHODCACHE:
+                    imageReadRecord(image + dataAt, dataLen, arg, &bytes, &blen);
+                    values[i] = newMethodCache(bytes, blen);
+                    break;
+
+                case IMAGE_MEMBERCACHE:
+                    imageReadRecord(image + dataAt, dataLen, arg, &bytes, &blen);
+                    values[i] = newMemberCache(bytes, blen);
+                    break;
+            }
+        }
+
+        if (kind == IMAGE_HELPER) {
+            calls[callCount * 2] = rels[i * 3];
+            calls[callCount * 2 + 1] = (size_t) values[i];
+            callCount++;
+        }
+    }
+
+    /* then place it, and fill in its immediates */
+    ret = placeCode(image + IMAGE_HEADER_WORDS * sizeof(size_t), codeLen, calls, callCount);
+    for (i = 0; i < relocCount; i++)
+        if (rels[i * 3 + 1] != IMAGE_HELPER)
+            memcpy(ret + rels[i * 3], &values[i], 8);
+
+    if (fastEntry)
+        *fastEntry = fast ? (void *) (ret + fast - 1) : NULL;
+
+    free(values);
+    free(calls);
+    return (sdyn_native_function_t) ret;
+}
+
+/* choose the target of an IR node based on its storage type */
+static struct SJA_X8664_Operand irTarget(struct SDyn_IR *ir, size_t i)
+{
+    switch (ir->stype[i]) {
+        case SDYN_STORAGE_STK:
+            return MEM(8, RSP, 0, RNONE, ir->addr[i]*8);
+
+        case SDYN_STORAGE_ASTK:
+        case SDYN_STORAGE_PSTK:
+            return MEM(8, R15, 0, RNONE, ir->addr[i]*8 + 16);
+
+        default:
+            return RAX;
+    }
+}
+
+/* the type of a value of this type once it's boxed */
+static int boxedType(int type)
+{
+    switch (type) {
+        case SDYN_TYPE_UNDEFINED: return SDYN_TYPE_BOXED_UNDEFINED;
+        case SDYN_TYPE_BOOL: return SDYN_TYPE_BOXED_BOOL;
+        case SDYN_TYPE_INT: return SDYN_TYPE_BOXED_INT;
+        default: return type;
+    }
+}
+
+/* is the type tag of a value of this type known statically? */
+static int knownTag(int type)
+{
+    return type != SDYN_TYPE_NIL && type != SDYN_TYPE_BOXED;
+}
+
+/* can the call at node i use fast entry points? It must have few enough
+ * arguments, and the types of those from first on must be known statically,
+ * so they're the same on every call. The ARG nodes immediately precede the
+ * call. */
+static int argTypesKnown(struct SDyn_IR *ir, size_t i, size_t argCt, size_t first)
+{
+    size_t j;
+
+    if (argCt > SDYN_FAST_ARGS) return 0;
+    for (j = first; j < argCt; j++) {
+        if (!knownTag(ir->rtype[ir->uidx[ir->left[i - argCt + j]]]))
+            return 0;
+    }
+    return 1;
+}
+
+/* can this node call out of the JIT code, and so collect? This must agree with
+ * what sdyn_compile emits for it. */
+static int mayCallOut(struct SDyn_IR *ir, size_t i)
+{
+    int type = ir->rtype[ir->uidx[i]];
+
+    switch (ir->op[i]) {
+        case SDYN_NODE_NOP:
+        case SDYN_NODE_UNIFY:
+        case SDYN_NODE_PARAM:
+        case SDYN_NODE_NIL:
+        case SDYN_NODE_STR:
+        case SDYN_NODE_TRUE:
+        case SDYN_NODE_FALSE:
+        case SDYN_NODE_TOP:
+            return 0;
+
+        case SDYN_NODE_NUM:
+            /* boxing a number allocates */
+            return type >= SDYN_TYPE_FIRST_BOXED;
+
+        case SDYN_NODE_ASSIGN:
+            if (type >= SDYN_TYPE_FIRST_BOXED) {
+                int leftType = ir->rtype[ir->uidx[ir->left[i]]];
+                return leftType == SDYN_TYPE_BOOL || leftType == SDYN_TYPE_INT;
+            }
+            return 0;
+
+        default:
+            return 1;
+    }
+}
+
+/* Find which words of the pointer stack frame must be initialized to
+ * undefined by PALLOCA (at node start). The collector scans the whole pointer
+ * stack, so every word must hold a valid pointer by the first call out of the
+ * function, and some (such as missing parameters) are read before they're
+ * written. But a word which straight-line code after PALLOCA writes before
+ * anything could call out or read it needn't be. Returns how many need it. */
+static size_t pstackInits(struct SDyn_IR *ir, size_t start, size_t words, char *init)
+{
+    size_t i, j, w, count, opnds[3];
+    char *touched;
+    int op;
+
+    touched = sdyn_arenaAlloc(ir->arena, words);
+    for (w = 0; w < words; w++) init[w] = 1;
+
+#define PSTKWORD(v) \
+    ((ir->stype[ir->uidx[v]] == SDYN_STORAGE_PSTK) ? ir->addr[ir->uidx[v]] + 2 : (size_t) -1)
+
+    for (i = start + 1; i < ir->length; i++) {
+        op = ir->op[i];
+
+        /* only nodes which never call out of the JIT code */
+        if (op == SDYN_NODE_NOP || op == SDYN_NODE_UNIFY) continue;
+        if (mayCallOut(ir, i)) break;
+
+        /* anything read first needs its default */
+        opnds[0] = ir->left[i];
+        opnds[1] = ir->right[i];
+        opnds[2] = ir->third[i];
+        for (j = 0; j < 3; j++) {
+            if (!opnds[j]) continue;
+            w = PSTKWORD(opnds[j]);
+            if (w < words) touched[w] = 1;
+        }
+
+        /* parameters are only written if they're provided */
+        w = PSTKWORD(i);
+        if (w < words && !touched[w] && op != SDYN_NODE_PARAM) init[w] = 0;
+        if (w < words) touched[w] = 1;
+    }
+
+#undef PSTKWORD
+
+    count = 0;
+    for (w = 0; w < words; w++)
+        if (init[w]) count++;
+    return count;
+}
+
+/* does the member store at node i need the write barrier? A generation's
+ * survivors are all promoted, so nothing is in an older generation until a
+ * collection, by which point the constants in sdyn_globals, which are always
+ * live, are too. Storing them never needs it. Neither does storing into an
+ * object made by OBJ with nothing since that could collect, which is still
+ * in the nursery, as are its members. */
+static int needsBarrier(struct SDyn_IR *ir, size_t i)
+{
+    size_t obj, j;
+    int rightType;
+
+    /* booleans box to sdyn_true and sdyn_false */
+    rightType = ir->rtype[ir->uidx[ir->right[i]]];
+    if (rightType == SDYN_TYPE_UNDEFINED || rightType == SDYN_TYPE_BOOL ||
+        ir->op[ir->right[i]] == SDYN_NODE_TOP)
+        return 0;
+
+    /* boxing anything else might collect */
+    if (rightType == SDYN_TYPE_INT) return 1;
+    for (obj = ir->left[i]; ir->op[obj] == SDYN_NODE_ASSIGN; obj = ir->left[obj]);
+    if (ir->op[obj] != SDYN_NODE_OBJ) return 1;
+    for (j = obj + 1; j < i; j++)
+        if (mayCallOut(ir, j)) return 1;
+    return 0;
+}
+
+/* compile IR into a native function. If fastEntry isn't NULL, it is set to
+ * the function's fast entry point, or NULL if it has none. If image isn't
+ * NULL, it is set to a malloc'd image of the function for sdyn_loadImage, and
+ * imageLen to its length, or NULL if it can't have one. */
+sdyn_native_function_t sdyn_compile(struct SDyn_IR *ir, void **fastEntry,
+        unsigned char **image, size_t *imageLen)
 {
-    SDyn_IRNode node = NULL, unode = NULL, onode = NULL;
     sdyn_native_function_t ret = NULL;
-    struct Buffer_uchar buf;
-    struct Buffer_size_t returns;
+    struct Buffer_uchar buf, cold, *code;
+    struct Peephole peep;
+    struct Buffer_size_t returns, coldEntries, hotCalls, coldCalls;
+    struct Buffer_size_t hotRelocs, coldRelocs;
+    struct Buffer_ColdStub coldStubs;
     struct SJA_X8664_Operand left, right, third, target;
     int leftType, rightType, thirdType, targetType;
-    size_t i, uidx, lastArg, unsuppCount;
+    size_t i, uidx, lastArg, unsuppCount, strIdx, strLen, prologueEnd, fastOffset;
+    size_t frameSize, pframeSize, firstParam, paramCount, bodyStart;
+    const unsigned char *str;
     long imm;
+    int hasFast;
+    struct SJA_X8664_Operand fastRegs[SDYN_FAST_ARGS];
 
     INIT_BUFFER(buf);
     INIT_BUFFER(returns);
-
-/* macros to write pseudo-assembly lines:
- * Cn(opcode, operands) for n-ary assembly instructions
- * CF(opcode, label) for forwards-referencing jumps
- * L(label) to define the label for CF jumps
- * IMM64 to load an immediate value of type size_t
- * IMM64P to load an immediate pointer value */
-#define C3(x, o1, o2, o3)   sja_compile(OP3(x, o1, o2, o3), &buf, NULL)
-#define C2(x, o1, o2)       sja_compile(OP2(x, o1, o2), &buf, NULL)
-#define C1(x, o1)           sja_compile(OP1(x, o1), &buf, NULL)
-#define C0(x)               sja_compile(OP0(x), &buf, NULL)
-#define CF(x, frel)         sja_compile(OP0(x), &buf, &(frel))
-#define IMM64(o1, v) do { \
-    size_t imm64 = (v); \
-    if (imm64 < 0x100000000L) { \
-        C2(MOV, o1, IMM(imm64)); \
-    } else if (imm64 & 0x80000000L) { \
-        C2(MOV, o1, IMM((~imm64)>>32)); \
-        C2(SHL, o1, IMM(32)); \
-        C2(XOR, o1, IMM(imm64&0xFFFFFFFFL)); \
-    } else { \
-        C2(MOV, o1, IMM(imm64>>32)); \
-        C2(SHL, o1, IMM(32)); \
-        C2(OR, o1, IMM(imm64&0xFFFFFFFFL)); \
-    } \
+    INIT_BUFFER(cold);
+    INIT_BUFFER(coldEntries);
+    INIT_BUFFER(coldStubs);
+    INIT_BUFFER(hotCalls);
+    INIT_BUFFER(coldCalls);
+    INIT_BUFFER(hotRelocs);
+    INIT_BUFFER(coldRelocs);
+    code = &buf;
+    PEEP_BARRIER();
+
+/* macros to write cold stubs:
+ * COLD_BEGIN() to start writing a cold stub
+ * COLD_ENTRY(label) to make a CF jump in the hot code jump to it
+ * COLD_END() to finish it, returning to the hot code at the current point
+ * Cold stubs may use CF and L within themselves, but not RREL. */
+#define COLD_BEGIN() do { \
+    while (BUFFER_SPACE(coldStubs) < 1) EXPAND_BUFFER(coldStubs); \
+    BUFFER_END(coldStubs)->start = cold.bufused; \
+    code = &cold; \
+    PEEP_BARRIER(); \
+} while(0)
+#define COLD_ENTRY(frel) do { \
+    while (BUFFER_SPACE(coldEntries) < 2) EXPAND_BUFFER(coldEntries); \
+    coldEntries.buf[coldEntries.bufused++] = coldStubs.bufused; \
+    coldEntries.buf[coldEntries.bufused++] = (frel); \
+} while(0)
+#define COLD_END() do { \
+    BUFFER_END(coldStubs)->end = cold.bufused; \
+    BUFFER_END(coldStubs)->resume = buf.bufused; \
+    coldStubs.bufused++; \
+    code = &buf; \
+    PEEP_BARRIER(); \
 } while(0)
-#define IMM64P(o1, v) IMM64(o1, (size_t) (void *) (v))
-#define L(frel)             sja_patchFrel(&buf, (frel))
-
-    GGC_PUSH_4(ir, node, unode, onode);
 
     /* for debugging sake, don't fail on unsupported operations until the end */
     unsuppCount = 0;
 
+    /* registers for arguments to fast entry points */
+    fastRegs[0] = RSI;
+    fastRegs[1] = RDX;
+    fastRegs[2] = RCX;
+    prologueEnd = fastOffset = 0;
+    hasFast = 0;
+    frameSize = pframeSize = firstParam = paramCount = bodyStart = 0;
+
     lastArg = 0;
+    strIdx = 0;
     for (i = 0; i < ir->length; i++) {
-        node = GGC_RAP(ir, i);
-        unode = node;
+        /* string operands are in node order, so just walk along with them */
+        str = NULL;
+        strLen = 0;
+        if (strIdx < ir->strCount && ir->strs[strIdx].node == i) {
+            str = ir->strs[strIdx].str;
+            strLen = ir->strs[strIdx].strLen;
+            strIdx++;
+        }
+
+        /* code in unreachable blocks is never run, so needn't be generated,
+         * but the control flow markers still have labels to place */
+        if (!ir->cfg->blocks[ir->cfg->nodeBlock[i]].reachable) {
+            switch (ir->op[i]) {
+                case SDYN_NODE_IF:
+                case SDYN_NODE_IFELSE:
+                case SDYN_NODE_IFEND:
+                case SDYN_NODE_WHILE:
+                case SDYN_NODE_WCOND:
+                case SDYN_NODE_WEND:
+                case SDYN_NODE_PPOPA:
+                case SDYN_NODE_POPA:
+                    break;
+
+                default:
+                    continue;
+            }
+        }
 
         /* find our desired targetType by looking for the unified IR node. Our
          * own rtype SHOULD be identical, but the unified target is the
          * canonical one. */
-        uidx = i;
-        while (GGC_RD(unode, uidx) != uidx) {
-            uidx = GGC_RD(unode, uidx);
-            unode = GGC_RAP(ir, uidx);
-        }
-        targetType = GGC_RD(unode, rtype);
+        uidx = ir->uidx[i];
+        targetType = ir->rtype[uidx];
 
         /* macro to load an operand (left, right, third) into a register */
 #define LOADOP(opa, defreg) do { \
-    if (GGC_RD(node, opa)) { \
-        uidx = GGC_RD(node, opa); \
-        onode = GGC_RAP(ir, uidx); \
-        while (GGC_RD(onode, uidx) != uidx) { \
-            uidx = GGC_RD(onode, uidx); \
-            onode = GGC_RAP(ir, uidx); \
-        } \
-        opa ## Type = GGC_RD(onode, rtype); \
-        if (GGC_RD(onode, stype) == SDYN_STORAGE_PSTK) { \
+    if (ir->opa[i]) { \
+        uidx = ir->uidx[ir->opa[i]]; \
+        opa ## Type = ir->rtype[uidx]; \
+        if (ir->stype[uidx] == SDYN_STORAGE_PSTK) { \
             opa = defreg; \
-            C2(MOV, defreg, MEM(8, RDI, 0, RNONE, GGC_RD(onode, addr) * 8 + 16)); \
-        } else if (GGC_RD(onode, stype) == SDYN_STORAGE_STK) { \
+            C2(MOV, defreg, MEM(8, R15, 0, RNONE, ir->addr[uidx] * 8 + 16)); \
+        } else if (ir->stype[uidx] == SDYN_STORAGE_STK) { \
             opa = defreg; \
-            C2(MOV, defreg, MEM(8, RSP, 0, RNONE, GGC_RD(onode, addr) * 8)); \
+            C2(MOV, defreg, MEM(8, RSP, 0, RNONE, ir->addr[uidx] * 8)); \
         } \
     } \
 } while(0)
 
-        /* macro to perform a call, saving our pointer stack (see architecture notes at the beginning of this file */
-#define JCALL(what) do { \
-    C2(MOV, MEM(8, RBP, 0, RNONE, -8), RDI); \
-    C1(CALL, what); \
-    C2(MOV, RDI, MEM(8, RBP, 0, RNONE, -8)); \
+        /* macro to call a runtime helper through its trampoline, which passes
+         * it our pointer stack (see architecture notes at the beginning of
+         * this file). The CALL's target is filled in once the code is placed. */
+#define HCALL(helper) do { \
+    struct Buffer_size_t *hcalls = (code == &cold) ? &coldCalls : &hotCalls; \
+    while (BUFFER_SPACE(*code) < 5) EXPAND_BUFFER(*code); \
+    code->buf[code->bufused++] = 0xE8; /* CALL rel32 */ \
+    while (BUFFER_SPACE(*hcalls) < 2) EXPAND_BUFFER(*hcalls); \
+    hcalls->buf[hcalls->bufused++] = code->bufused; \
+    hcalls->buf[hcalls->bufused++] = (size_t) (void *) (helper); \
+    memset(BUFFER_END(*code), 0, 4); \
+    code->bufused += 4; \
+} while(0)
+
+        /* macro to load a pointer to a runtime object, as a relocation of
+         * this kind in the function's image (see struct ImageReloc) */
+#define RIMM64P(o1, kind, v) do { \
+    struct Buffer_size_t *rels = (code == &cold) ? &coldRelocs : &hotRelocs; \
+    while (BUFFER_SPACE(*rels) < 4) EXPAND_BUFFER(*rels); \
+    rels->buf[rels->bufused++] = movAbs(code, o1, (size_t) (void *) (v)); \
+    rels->buf[rels->bufused++] = (kind); \
+    rels->buf[rels->bufused++] = (size_t) (void *) (v); \
+    rels->buf[rels->bufused++] = i; \
+} while(0)
+
+        /* macro to call the fast entry point in RAX with the arguments in the
+         * argument stack. For tail calls, the arguments are in registers, so
+         * we can pop our frames first and let the callee return straight to
+         * our caller, passing it our caller's pointer stack. */
+#define FASTCALL(argCt, tail) do { \
+    size_t fcj; \
+    for (fcj = 0; fcj < (argCt); fcj++) \
+        C2(MOV, fastRegs[fcj], MEM(8, R15, 0, RNONE, fcj*8 + 16)); \
+    C2(MOV, RDI, R15); \
+    if (tail) { \
+        C2(ADD, RDI, IMM(pframeSize)); \
+        C2(ADD, RSP, IMM(frameSize)); \
+        C1(POP, R14); \
+        C1(POP, R15); \
+        C1(POP, RBP); \
+        C1(JMP, RAX); \
+    } else { \
+        C1(CALL, RAX); \
+    } \
 } while(0)
 
         /* macro to box a value of any type */
 #define BOX(type, targ, reg) do { \
     switch (type) { \
         case SDYN_TYPE_UNDEFINED: \
-            IMM64P(RAX, &sdyn_undefined); \
-            C2(MOV, targ, MEM(8, RAX, 0, RNONE, 0)); \
+            C2(MOV, targ, GLOBAL(undefined)); \
             break; \
             \
         case SDYN_TYPE_BOOL: \
             C2(MOV, RSI, reg); \
-            IMM64P(RAX, sdyn_boxBool); \
-            JCALL(RAX); \
+            HCALL(sdyn_boxBool); \
             C2(MOV, targ, RAX); \
             break; \
             \
         case SDYN_TYPE_INT: \
             C2(MOV, RSI, reg); \
-            IMM64P(RAX, sdyn_boxInt); \
-            JCALL(RAX); \
+            HCALL(sdyn_boxInt); \
             C2(MOV, targ, RAX); \
             break; \
             \
@@ -195,58 +1294,104 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
     } \
 } while(0)
 
-        /* choose our target based on the storage type */
-        switch (GGC_RD(node, stype)) {
-            case SDYN_STORAGE_STK:
-                target = MEM(8, RSP, 0, RNONE, GGC_RD(node, addr)*8);
-                break;
-
-            case SDYN_STORAGE_ASTK:
-            case SDYN_STORAGE_PSTK:
-                target = MEM(8, RDI, 0, RNONE, GGC_RD(node, addr)*8 + 16);
-                break;
+        /* macros to coerce the boxed value in RSI to a number or boolean in
+         * RAX. If its type isn't known, the likely type is checked for
+         * inline, and only anything else is coerced, out of line. */
+#define COERCE(type, likely, func) do { \
+    if ((type) == (likely)) { \
+        C2(MOV, RAX, MEM(8, RSI, 0, RNONE, 8)); \
+    } else if ((type) == SDYN_TYPE_BOXED) { \
+        size_t unlikely; \
+        C2(MOV, RAX, MEM(8, RSI, 0, RNONE, 0)); \
+        C2(MOV, RAX, MEM(8, RAX, 0, RNONE, 8)); \
+        C2(MOV, RAX, MEM(8, RAX, 0, RNONE, 8)); \
+        C2(CMP, RAX, IMM(likely)); \
+        CF(JNEF, unlikely); \
+        C2(MOV, RAX, MEM(8, RSI, 0, RNONE, 8)); \
+        COLD_BEGIN(); \
+        COLD_ENTRY(unlikely); \
+        HCALL(func); \
+        COLD_END(); \
+    } else { \
+        HCALL(func); \
+    } \
+} while(0)
+#define TONUMBER(type)  COERCE(type, SDYN_TYPE_BOXED_INT, sdyn_toNumber)
+#define TOBOOLEAN(type) COERCE(type, SDYN_TYPE_BOXED_BOOL, sdyn_toBoolean)
 
-            default:
-                target = RAX;
-        }
+        target = irTarget(ir, i);
 
-        switch (GGC_RD(node, op)) {
+        switch (ir->op[i]) {
             case SDYN_NODE_ALLOCA:
-                imm = GGC_RD(node, imm) + 2; /* 2 extra slots for temporaries */
+                imm = ir->imm[i] + 2; /* 2 extra slots for temporaries */
                 /* must align stack to 16 by Unix calling conventions */
                 if ((imm % 2) != 0) imm++;
                 /* 8 bytes per word */
                 imm *= 8;
 
-                /* standard entry code */
+                /* standard entry code, then pin the pointer stack and
+                 * globals. The two pushes keep the stack aligned. */
                 C1(PUSH, RBP);
                 C2(MOV, RBP, RSP);
+                C1(PUSH, R15);
+                C1(PUSH, R14);
+                C2(MOV, R15, RDI);
+                RIMM64P(R14, IMAGE_GLOBALS, &sdyn_globals);
                 C2(SUB, RSP, IMM(imm));
+                frameSize = imm;
                 break;
 
             case SDYN_NODE_PALLOCA:
             {
-                size_t j;
-
-                imm = GGC_RD(node, imm) * 8 + 16; /* two extra words for temporaries */
-
-                /* explicitly assign sdyn_undefined to all new slots, so all
-                 * pointers are valid */
-                C2(SUB, RDI, IMM(imm));
-                IMM64P(RAX, &sdyn_undefined);
-                C2(MOV, RAX, MEM(8, RAX, 0, RNONE, 0));
-                for (j = 0; j < imm; j += 8)
-                    C2(MOV, MEM(8, RDI, 0, RNONE, j), RAX);
+                size_t j, k, words, params;
+                char *init;
+
+                imm = ir->imm[i] * 8 + 16; /* two extra words for temporaries */
+                C2(SUB, R15, IMM(imm));
+                pframeSize = imm;
+
+                /* explicitly assign sdyn_undefined to new slots, so all
+                 * pointers are valid, except those that are written first */
+                words = imm / 8;
+                init = sdyn_arenaAlloc(ir->arena, words);
+                if (pstackInits(ir, i, words, init))
+                    C2(MOV, RAX, GLOBAL(undefined));
+
+                /* long runs are filled with REP STOSQ, which needs RCX, so
+                 * can't be used if the fast entry point takes its third
+                 * argument there */
+                for (params = 0, j = i + 1; j < ir->length && ir->op[j] == SDYN_NODE_PARAM; j++)
+                    params++;
+                for (j = 0; j < words; j = k) {
+                    for (; j < words && !init[j]; j++);
+                    for (k = j; k < words && init[k]; k++);
+                    if (k - j >= PSTACK_STOS_MIN && (params < 3 || params > SDYN_FAST_ARGS)) {
+                        C2(LEA, RDI, MEM(8, R15, 0, RNONE, j*8));
+                        C2(MOV, RCX, IMM(k - j));
+                        while (BUFFER_SPACE(buf) < 3) EXPAND_BUFFER(buf);
+                        buf.buf[buf.bufused++] = 0xF3; /* REP STOSQ */
+                        buf.buf[buf.bufused++] = 0x48;
+                        buf.buf[buf.bufused++] = 0xAB;
+                    } else {
+                        for (; j < k; j++)
+                            C2(MOV, MEM(8, R15, 0, RNONE, j*8), RAX);
+                    }
+                }
 
+                /* the fast entry point repeats everything up to here */
+                prologueEnd = buf.bufused;
+                PEEP_BARRIER();
                 break;
             }
 
             case SDYN_NODE_POPA:
-                imm = GGC_RD(node, imm) + 2;
+                imm = ir->imm[i] + 2;
                 /* must align stack to 16 */
                 if ((imm % 2) != 0) imm++;
                 imm *= 8;
                 C2(ADD, RSP, IMM(imm));
+                C1(POP, R14);
+                C1(POP, R15);
                 C1(POP, RBP);
                 C0(RET);
                 break;
@@ -255,11 +1400,12 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
             {
                 size_t j;
                 /* since PPOPA ends the function body, we use this time to fix
-                 * up all the forward references */
-                for (j = 0; j < returns.bufused; j++)
-                    sja_patchFrel(&buf, returns.buf[j]);
-                imm = GGC_RD(node, imm) * 8 + 16;
-                C2(ADD, RDI, IMM(imm));
+                 * up all the forward references. The last may be a jump to
+                 * right here, which the peephole optimizer can drop. */
+                for (j = returns.bufused; j > 0; j--)
+                    L(returns.buf[j - 1]);
+                imm = ir->imm[i] * 8 + 16;
+                C2(ADD, R15, IMM(imm));
                 break;
             }
 
@@ -276,13 +1422,12 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
                 }
                 if (leftType != SDYN_TYPE_BOOL) {
                     BOX(leftType, RSI, RAX);
-                    IMM64P(RAX, sdyn_toBoolean);
-                    JCALL(RAX);
+                    TOBOOLEAN(leftType);
                 }
 
                 C2(CMP, RAX, IMM(0));
                 CF(JEF, ifelse);
-                GGC_WD(node, imm, ifelse);
+                ir->imm[i] = ifelse;
                 break;
             }
 
@@ -291,12 +1436,11 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
                 /* first off, jump out of the if */
                 size_t ifelse, ifend;
                 CF(JMPF, ifend);
-                GGC_WD(node, imm, ifend);
+                ir->imm[i] = ifend;
 
                 /* now make the jump in for the else */
-                ifelse = GGC_RD(node, left);
-                onode = GGC_RAP(ir, ifelse);
-                ifelse = GGC_RD(onode, imm);
+                ifelse = ir->left[i];
+                ifelse = ir->imm[ifelse];
                 L(ifelse);
                 break;
             }
@@ -305,9 +1449,8 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
             {
                 /* make the jump out of the if */
                 size_t ifend;
-                ifend = GGC_RD(node, left);
-                onode = GGC_RAP(ir, ifend);
-                ifend = GGC_RD(onode, imm);
+                ifend = ir->left[i];
+                ifend = ir->imm[ifend];
                 L(ifend);
                 break;
             }
@@ -320,7 +1463,8 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
                  * is otherwise unused */
                 size_t wstart;
                 wstart = buf.bufused;
-                GGC_WD(node, imm, wstart);
+                ir->imm[i] = wstart;
+                PEEP_BARRIER();
                 break;
             }
 
@@ -339,8 +1483,7 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
                 if (leftType >= SDYN_TYPE_FIRST_BOXED) {
                     /* boolify it */
                     C2(MOV, RSI, RAX);
-                    IMM64P(RAX, sdyn_toBoolean);
-                    JCALL(RAX);
+                    TOBOOLEAN(leftType);
                 }
 
                 /* now it's ready to check */
@@ -348,7 +1491,7 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
                 CF(JEF, wcond);
 
                 /* we don't know where to jump to yet, so we save the label in the imm field */
-                GGC_WD(node, imm, wcond);
+                ir->imm[i] = wcond;
                 break;
             }
 
@@ -357,13 +1500,11 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
                 size_t wstart, wcond;
 
                 /* get our wstart and wcond program counters */
-                wstart = GGC_RD(node, left);
-                onode = GGC_RAP(ir, wstart);
-                wstart = GGC_RD(onode, imm);
+                wstart = ir->left[i];
+                wstart = ir->imm[wstart];
 
-                wcond = GGC_RD(node, right);
-                onode = GGC_RAP(ir, wcond);
-                wcond = GGC_RD(onode, imm);
+                wcond = ir->right[i];
+                wcond = ir->imm[wcond];
 
                 /* just jump back to the beginning */
                 C1(JMPR, RREL(wstart));
@@ -384,50 +1525,281 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
                  * load in an argument value. Because PALLOCA defaults
                  * everything to undefined, we don't have to do anything if
                  * insufficient arguments were provided. */
-                C2(CMP, RSI, IMM(GGC_RD(node, imm)));
+                C2(CMP, RSI, IMM(ir->imm[i]));
                 CF(JLEF, nonExist); /* argument not provided */
-                C2(MOV, RAX, MEM(8, RDX, 0, RNONE, GGC_RD(node, imm)*8)); /* get it from RDX */
+                C2(MOV, RAX, MEM(8, RDX, 0, RNONE, ir->imm[i]*8)); /* get it from RDX */
                 C2(MOV, target, RAX);
                 L(nonExist);
 
+                /* after the last parameter, functions with few enough
+                 * parameters get a fast entry point, which takes its arguments
+                 * in registers. It repeats the prologue, stores the arguments
+                 * and joins the normal entry here. The prologue must leave the
+                 * argument registers alone: it writes RAX, and for REP STOSQ
+                 * RDI, which is already copied to R15 by then, and RCX, which
+                 * PALLOCA only does when RCX isn't an argument. */
+                if (ir->op[i + 1] != SDYN_NODE_PARAM && ir->imm[i] < SDYN_FAST_ARGS) {
+                    size_t body, j, r;
+
+                    CF(JMPF, body);
+                    fastOffset = buf.bufused;
+                    hasFast = 1;
+                    while (BUFFER_SPACE(buf) < prologueEnd) EXPAND_BUFFER(buf);
+                    memcpy(BUFFER_END(buf), buf.buf, prologueEnd);
+                    buf.bufused += prologueEnd;
+
+                    /* and the prologue's relocations with it */
+                    for (r = 0; r < hotRelocs.bufused && hotRelocs.buf[r] < prologueEnd; r += 4) {
+                        while (BUFFER_SPACE(hotRelocs) < 4) EXPAND_BUFFER(hotRelocs);
+                        hotRelocs.buf[hotRelocs.bufused++] = fastOffset + hotRelocs.buf[r];
+                        hotRelocs.buf[hotRelocs.bufused++] = hotRelocs.buf[r + 1];
+                        hotRelocs.buf[hotRelocs.bufused++] = hotRelocs.buf[r + 2];
+                        hotRelocs.buf[hotRelocs.bufused++] = hotRelocs.buf[r + 3];
+                    }
+                    for (j = i - ir->imm[i]; j <= i; j++)
+                        C2(MOV, irTarget(ir, j), fastRegs[ir->imm[j]]);
+                    L(body);
+                }
+
+                /* self tail calls jump to just after the parameters */
+                if (ir->imm[i] == 0) firstParam = i;
+                paramCount = ir->imm[i] + 1;
+                bodyStart = buf.bufused;
+                PEEP_BARRIER();
+
                 break;
             }
 
             case SDYN_NODE_INTRINSICCALL:
                 /* just get the address of the intrinsic and call it */
                 C2(MOV, RSI, IMM(lastArg + 1));
-                C2(LEA, RDX, MEM(8, RDI, 0, RNONE, 16));
-                IMM64P(RAX, sdyn_getIntrinsic((SDyn_String) GGC_RP(node, immp)));
-                JCALL(RAX);
+                C2(LEA, RDX, MEM(8, R15, 0, RNONE, 16));
+                HCALL(sdyn_getIntrinsic(sdyn_internString(NULL, (char *) str, strLen)));
                 C2(MOV, target, RAX);
                 break;
 
             case SDYN_NODE_CALL:
+            {
+                struct SDyn_CallCache *cache;
+                size_t argCt, j, notFunction, miss;
+                int known, tail, self, ptype, atype;
+
                 /* left is the function to call, args are handled in ARG nodes */
                 LOADOP(left, RAX);
                 BOX(leftType, RSI, left);
+                argCt = lastArg + 1;
+
+                /* a call whose result is returned immediately is a tail call */
+                tail = (ir->op[i + 1] == SDYN_NODE_RETURN && ir->left[i + 1] == i);
+
+                /* if it's a tail call to ourself (marked by the IR compiler
+                 * with our source), and the arguments have the types we're
+                 * specialized for, we can just replace our parameters and
+                 * jump back to the start of the body */
+                self = (tail && ir->imm[i]);
+                for (j = 0; self && j < paramCount; j++) {
+                    ptype = ir->rtype[ir->uidx[firstParam + j]];
+                    if (ptype == SDYN_TYPE_BOXED) continue;
+                    if (j < argCt)
+                        atype = boxedType(ir->rtype[ir->uidx[ir->left[i - argCt + j]]]);
+                    else
+                        atype = SDYN_TYPE_BOXED_UNDEFINED;
+                    self = (atype == ptype);
+                }
+                if (self) {
+                    /* check that the global is still us */
+                    C2(MOV, RAX, MEM(8, RSI, 0, RNONE, 0));
+                    C2(MOV, RAX, MEM(8, RAX, 0, RNONE, 8));
+                    C2(MOV, RAX, MEM(8, RAX, 0, RNONE, 8));
+                    C2(CMP, RAX, IMM(SDYN_TYPE_FUNCTION));
+                    CF(JNEF, notFunction);
+                    RIMM64P(RAX, IMAGE_SELF, ir->imm[i]);
+                    C2(CMP, RAX, MEM(8, RSI, 0, RNONE, DOFFSET(SDyn_Function, source)));
+                    CF(JNEF, miss);
+
+                    /* the arguments are in the argument stack, which no
+                     * parameter shares, so they can be copied in any order */
+                    for (j = 0; j < paramCount; j++) {
+                        if (j < argCt) {
+                            C2(MOV, RAX, MEM(8, R15, 0, RNONE, j*8 + 16));
+                        } else {
+                            C2(MOV, RAX, GLOBAL(undefined));
+                        }
+                        C2(MOV, irTarget(ir, firstParam + j), RAX);
+                    }
+                    C1(JMPR, RREL(bodyStart));
+
+                    /* otherwise it's just a normal call */
+                    L(notFunction);
+                    L(miss);
+                }
+
+                /* if we can use fast entry points, remember the callee's in a
+                 * call cache */
+                known = argTypesKnown(ir, i, argCt, 0);
+                if (known) {
+                    cache = newCallCache();
+
+                    /* check that it's a function (see SPECULATE) */
+                    C2(MOV, RAX, MEM(8, RSI, 0, RNONE, 0));
+                    C2(MOV, RAX, MEM(8, RAX, 0, RNONE, 8));
+                    C2(MOV, RAX, MEM(8, RAX, 0, RNONE, 8));
+                    C2(CMP, RAX, IMM(SDYN_TYPE_FUNCTION));
+                    CF(JNEF, notFunction);
+
+                    /* and that it's the one in the cache */
+                    RIMM64P(RCX, IMAGE_CALLCACHE, cache);
+                    C2(MOV, RAX, MEM(8, RSI, 0, RNONE, DOFFSET(SDyn_Function, source)));
+                    C2(CMP, RAX, MEM(8, RCX, 0, RNONE, offsetof(struct SDyn_CallCache, source)));
+                    CF(JNEF, miss);
+
+                    /* it is, so call its fast entry point directly. JIT
+                     * functions preserve R15, so this needn't be an HCALL. */
+                    C2(MOV, RAX, MEM(8, RCX, 0, RNONE, offsetof(struct SDyn_CallCache, fast)));
+                    FASTCALL(argCt, tail);
+
+                    /* otherwise, go through sdyn_callCached out of line,
+                     * which will fill the cache */
+                    COLD_BEGIN();
+                    COLD_ENTRY(notFunction);
+                    COLD_ENTRY(miss);
+                    C2(MOV, RDX, IMM(argCt));
+                    C2(LEA, RCX, MEM(8, R15, 0, RNONE, 16));
+                    RIMM64P(R8, IMAGE_CALLCACHE, cache);
+                    HCALL(sdyn_callCached);
+                    COLD_END();
+                    C2(MOV, target, RAX);
+                    break;
+                }
 
                 /* save the hopefully-function in GC'd space */
-                C2(MOV, MEM(8, RDI, 0, RNONE, 0), RSI);
+                C2(MOV, MEM(8, R15, 0, RNONE, 0), RSI);
 
                 /* assert that it's a function */
-                IMM64P(RAX, sdyn_assertFunction);
-                JCALL(RAX);
+                HCALL(sdyn_assertFunction);
 
                 /* reload it from GC'd space (in case it's moved) */
-                C2(MOV, RSI, MEM(8, RDI, 0, RNONE, 0));
+                C2(MOV, RSI, MEM(8, R15, 0, RNONE, 0));
 
                 /* pass in the number of arguments */
                 C2(MOV, RDX, IMM(lastArg + 1));
 
-                /* ARG loads to RDI+16, so just provide that address as the base for arguments */
-                C2(LEA, RCX, MEM(8, RDI, 0, RNONE, 16));
+                /* ARG loads to R15+16, so just provide that address as the base for arguments */
+                C2(LEA, RCX, MEM(8, R15, 0, RNONE, 16));
 
                 /* then call sdyn_call */
-                IMM64P(RAX, sdyn_call);
-                JCALL(RAX);
+                HCALL(sdyn_call);
+                C2(MOV, target, RAX);
+                break;
+            }
+
+            case SDYN_NODE_CALLMEMBER:
+            {
+                struct SDyn_MethodCache *cache;
+                size_t argCt, notObject, missShape, notFunction, missFunction;
+                int known, tail;
+
+                /* left is the receiver, which is also the first argument */
+                LOADOP(left, RAX);
+                BOX(leftType, RSI, left);
+                argCt = lastArg + 1;
+                tail = (ir->op[i + 1] == SDYN_NODE_RETURN && ir->left[i + 1] == i);
+
+                cache = newMethodCache(str, strLen);
+
+                /* the receiver is checked to be an object, so only the other
+                 * arguments' types need to be known to use the fast entry */
+                known = argTypesKnown(ir, i, argCt, 1);
+                if (known) {
+                    /* check that it's an object of the shape in the cache */
+                    C2(MOV, RAX, MEM(8, RSI, 0, RNONE, 0));
+                    C2(MOV, RAX, MEM(8, RAX, 0, RNONE, 8));
+                    C2(MOV, RAX, MEM(8, RAX, 0, RNONE, 8));
+                    C2(CMP, RAX, IMM(SDYN_TYPE_OBJECT));
+                    CF(JNEF, notObject);
+                    RIMM64P(RCX, IMAGE_METHODCACHE, cache);
+                    C2(MOV, RDX, MEM(8, RCX, 0, RNONE, offsetof(struct SDyn_MethodCache, shape)));
+                    C2(MOV, RAX, MEM(8, RSI, 0, RNONE, POFFSET(SDyn_Object, shape)));
+                    C2(CMP, RAX, MEM(8, RDX, 0, RNONE, 0));
+                    CF(JNEF, missShape);
+
+                    /* so the method is at the cached index */
+                    C2(MOV, RDX, MEM(8, RCX, 0, RNONE, offsetof(struct SDyn_MethodCache, index)));
+                    C2(SHL, RDX, IMM(3));
+                    C2(ADD, RDX, MEM(8, RSI, 0, RNONE, POFFSET(SDyn_Object, members)));
+                    C2(MOV, RAX, MEM(8, RDX, 0, RNONE, PAOFFSET));
+
+                    /* which must be the function in the cache */
+                    C2(MOV, RDX, MEM(8, RAX, 0, RNONE, 0));
+                    C2(MOV, RDX, MEM(8, RDX, 0, RNONE, 8));
+                    C2(MOV, RDX, MEM(8, RDX, 0, RNONE, 8));
+                    C2(CMP, RDX, IMM(SDYN_TYPE_FUNCTION));
+                    CF(JNEF, notFunction);
+                    C2(MOV, RDX, MEM(8, RAX, 0, RNONE, DOFFSET(SDyn_Function, source)));
+                    C2(CMP, RDX, MEM(8, RCX, 0, RNONE, offsetof(struct SDyn_MethodCache, call.source)));
+                    CF(JNEF, missFunction);
+
+                    /* all hits, so call its fast entry point directly */
+                    C2(MOV, RAX, MEM(8, RCX, 0, RNONE, offsetof(struct SDyn_MethodCache, call.fast)));
+                    FASTCALL(argCt, tail);
+
+                    /* any miss goes out of line */
+                    COLD_BEGIN();
+                    COLD_ENTRY(notObject);
+                    COLD_ENTRY(missShape);
+                    COLD_ENTRY(notFunction);
+                    COLD_ENTRY(missFunction);
+                }
+
+                /* otherwise, sdyn_callMethod looks it up and fills the cache */
+                C2(MOV, RDX, IMM(argCt));
+                C2(LEA, RCX, MEM(8, R15, 0, RNONE, 16));
+                RIMM64P(R8, IMAGE_METHODCACHE, cache);
+                HCALL(sdyn_callMethod);
+                if (known) COLD_END();
+                C2(MOV, target, RAX);
+                break;
+            }
+
+            case SDYN_NODE_CHECKFUNC:
+            {
+                size_t notFunction, notSame;
+
+                LOADOP(left, RSI);
+
+                /* only a boxed value can be a function */
+                if (leftType != SDYN_TYPE_BOXED && leftType != SDYN_TYPE_FUNCTION) {
+                    C2(MOV, target, IMM(0));
+                    break;
+                }
+
+                /* check its type tag (see SPECULATE) */
+                C2(MOV, RAX, MEM(8, RSI, 0, RNONE, 0));
+                C2(MOV, RAX, MEM(8, RAX, 0, RNONE, 8));
+                C2(MOV, RAX, MEM(8, RAX, 0, RNONE, 8));
+                C2(CMP, RAX, IMM(SDYN_TYPE_FUNCTION));
+                CF(JNEF, notFunction);
+
+                /* then that it's the function we expect */
+                RIMM64P(RAX, IMAGE_FUNCTION, ir->imm[i]);
+                C2(CMP, RAX, MEM(8, RSI, 0, RNONE, DOFFSET(SDyn_Function, source)));
+                CF(JNEF, notSame);
+                C2(MOV, RAX, IMM(1));
+
+                /* which it almost always is, so failure is out of line */
+                COLD_BEGIN();
+                COLD_ENTRY(notFunction);
+                COLD_ENTRY(notSame);
+                C2(MOV, RAX, IMM(0));
+                COLD_END();
+
+                if (targetType >= SDYN_TYPE_FIRST_BOXED) {
+                    C2(MOV, RSI, RAX);
+                    HCALL(sdyn_boxBool);
+                }
                 C2(MOV, target, RAX);
                 break;
+            }
 
             case SDYN_NODE_ASSIGN:
                 /* assignments don't really exist in IR, so this is just a move, possibly boxing */
@@ -446,20 +1818,18 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
 
                 if (leftType != SDYN_TYPE_OBJECT) {
                     /* coerce it */
-                    IMM64P(RAX, sdyn_toObject);
-                    JCALL(RAX);
+                    HCALL(sdyn_toObject);
                     C2(MOV, RSI, RAX);
                 }
 
                 /* put the string member name somewhere to load at runtime */
                 gstring = (SDyn_String *) createPointer();
-                *gstring = GGC_RP(node, immp);
-                IMM64P(RDX, gstring);
+                *gstring = sdyn_internString(NULL, (char *) str, strLen);
+                RIMM64P(RDX, IMAGE_STRING, gstring);
                 C2(MOV, RDX, MEM(8, RDX, 0, RNONE, 0));
 
                 /* get everything into place and call */
-                IMM64P(RAX, sdyn_getObjectMember);
-                JCALL(RAX);
+                HCALL(sdyn_getObjectMember);
 
                 C2(MOV, target, RAX);
                 break;
@@ -467,33 +1837,61 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
 
             case SDYN_NODE_ASSIGNMEMBER:
             {
-                SDyn_String *gstring;
+                struct SDyn_MemberCache *cache;
+                size_t miss;
 
                 LOADOP(left, RAX);
                 BOX(leftType, RSI, left);
 
                 if (leftType != SDYN_TYPE_OBJECT) {
                     /* coerce it */
-                    IMM64P(RAX, sdyn_toObject);
-                    JCALL(RAX);
+                    HCALL(sdyn_toObject);
                     C2(MOV, RSI, RAX);
                 }
 
-                C2(MOV, MEM(8, RDI, 0, RNONE, 0), RSI);
+                C2(MOV, MEM(8, R15, 0, RNONE, 0), RSI);
 
                 LOADOP(right, RAX);
                 BOX(rightType, RCX, right);
-                C2(MOV, RSI, MEM(8, RDI, 0, RNONE, 0));
+                C2(MOV, RSI, MEM(8, R15, 0, RNONE, 0));
 
-                /* make the string globally accessible */
-                gstring = (SDyn_String *) createPointer();
-                *gstring = GGC_RP(node, immp);
-                IMM64P(RDX, gstring);
-                C2(MOV, RDX, MEM(8, RDX, 0, RNONE, 0));
+                cache = newMemberCache(str, strLen);
 
-                /* get everything into place and call */
-                IMM64P(RAX, sdyn_setObjectMember);
-                JCALL(RAX);
+                /* if the object has the shape in the cache, the member is at
+                 * the cached index, and is simply stored */
+                RIMM64P(RDX, IMAGE_MEMBERCACHE, cache);
+                C2(MOV, RAX, MEM(8, RDX, 0, RNONE, offsetof(struct SDyn_MemberCache, shape)));
+                C2(MOV, RAX, MEM(8, RAX, 0, RNONE, 0));
+                C2(CMP, RAX, MEM(8, RSI, 0, RNONE, POFFSET(SDyn_Object, shape)));
+                CF(JNEF, miss);
+                C2(MOV, RDX, MEM(8, RDX, 0, RNONE, offsetof(struct SDyn_MemberCache, index)));
+                C2(MOV, RSI, MEM(8, RSI, 0, RNONE, POFFSET(SDyn_Object, members)));
+                C2(MOV, MEM(8, RSI, 8, RDX, PAOFFSET), RCX);
+
+                if (needsBarrier(ir, i)) {
+                    /* remember the members' card if their pool is in an older
+                     * generation, as GGC_WAP does */
+                    size_t young;
+
+                    C2(MOV, RAX, RSI);
+                    C2(AND, RAX, IMM(GGGGC_POOL_OUTER_MASK));
+                    C2(CMP, MEM(1, RAX, 0, RNONE, POOLGENOFFSET), IMM(0));
+                    CF(JEF, young);
+                    C2(MOV, RDX, RSI);
+                    C2(AND, RDX, IMM(GGGGC_POOL_INNER_MASK));
+                    C2(SHR, RDX, IMM(GGGGC_CARD_SIZE));
+                    C2(MOV, MEM(1, RAX, 1, RDX, POOLREMEMBEROFFSET), IMM(1));
+                    L(young);
+                }
+
+                /* otherwise, look it up by name and fill the cache */
+                COLD_BEGIN();
+                COLD_ENTRY(miss);
+                C2(MOV, RAX, RCX);
+                C2(MOV, RCX, RDX);
+                C2(MOV, RDX, RAX);
+                HCALL(sdyn_setObjectMemberCached);
+                COLD_END();
 
                 LOADOP(right, RAX);
                 C2(MOV, target, RAX);
@@ -506,21 +1904,25 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
                 BOX(leftType, RSI, left);
 
                 /* save it in GC'd space */
-                C2(MOV, MEM(8, RDI, 0, RNONE, 0), RSI);
+                C2(MOV, MEM(8, R15, 0, RNONE, 0), RSI);
 
                 /* right is the "index", which will be coerced to a string */
                 LOADOP(right, RAX);
-                BOX(rightType, RSI, right);
-                IMM64P(RAX, sdyn_toString);
-                JCALL(RAX);
+                if (rightType == SDYN_TYPE_INT) {
+                    /* no need to box it just to unbox it */
+                    C2(MOV, RSI, right);
+                    HCALL(sdyn_intToString);
+                } else {
+                    BOX(rightType, RSI, right);
+                    HCALL(sdyn_toString);
+                }
                 C2(MOV, RDX, RAX);
 
                 /* reload the object */
-                C2(MOV, RSI, MEM(8, RDI, 0, RNONE, 0));
+                C2(MOV, RSI, MEM(8, R15, 0, RNONE, 0));
 
                 /* then simply sdyn_getObjectMember to access */
-                IMM64P(RAX, sdyn_getObjectMember);
-                JCALL(RAX);
+                HCALL(sdyn_getObjectMember);
 
                 C2(MOV, target, RAX);
                 break;
@@ -529,22 +1931,25 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
                 /* (similar to above, but with a value) */
                 LOADOP(left, RAX);
                 BOX(leftType, RSI, left);
-                C2(MOV, MEM(8, RDI, 0, RNONE, 0), RSI);
+                C2(MOV, MEM(8, R15, 0, RNONE, 0), RSI);
 
                 LOADOP(right, RAX);
-                BOX(rightType, RSI, right);
-                IMM64P(RAX, sdyn_toString);
-                JCALL(RAX);
-                C2(MOV, MEM(8, RDI, 0, RNONE, 8), RAX);
+                if (rightType == SDYN_TYPE_INT) {
+                    C2(MOV, RSI, right);
+                    HCALL(sdyn_intToString);
+                } else {
+                    BOX(rightType, RSI, right);
+                    HCALL(sdyn_toString);
+                }
+                C2(MOV, MEM(8, R15, 0, RNONE, 8), RAX);
 
                 LOADOP(third, RCX);
                 BOX(thirdType, RCX, third);
 
-                C2(MOV, RSI, MEM(8, RDI, 0, RNONE, 0));
-                C2(MOV, RDX, MEM(8, RDI, 0, RNONE, 8));
+                C2(MOV, RSI, MEM(8, R15, 0, RNONE, 0));
+                C2(MOV, RDX, MEM(8, R15, 0, RNONE, 8));
 
-                IMM64P(RAX, sdyn_setObjectMember);
-                JCALL(RAX);
+                HCALL(sdyn_setObjectMember);
 
                 LOADOP(third, RAX);
                 C2(MOV, target, RAX);
@@ -554,7 +1959,7 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
                 LOADOP(left, RSI);
 
                 /* we'll store our label address in imm. Set it to 0 for non-label cases */
-                GGC_WD(node, imm, 0);
+                ir->imm[i] = 0;
 
                 /* first off, this is very silly if our input type is already right */
                 if (targetType == leftType) {
@@ -574,26 +1979,23 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
 
                     } else if ((leftType == SDYN_TYPE_UNDEFINED) && (targetType == SDYN_TYPE_BOXED_UNDEFINED)) {
                         /* box the undefined value */
-                        IMM64P(RAX, &sdyn_undefined);
-                        C2(MOV, target, MEM(8, RAX, 0, RNONE, 0));
+                        C2(MOV, target, GLOBAL(undefined));
 
                     } else if ((leftType == SDYN_TYPE_BOOL) && (targetType == SDYN_TYPE_BOXED_BOOL)) {
                         /* box the bool */
-                        IMM64P(RAX, sdyn_boxBool);
-                        JCALL(RAX);
+                        HCALL(sdyn_boxBool);
                         C2(MOV, target, RAX);
 
                     } else if ((leftType == SDYN_TYPE_INT) && (targetType == SDYN_TYPE_BOXED_INT)) {
                         /* box the int */
-                        IMM64P(RAX, sdyn_boxInt);
-                        JCALL(RAX);
+                        HCALL(sdyn_boxInt);
                         C2(MOV, target, RAX);
 
                     } else {
                         /* speculation can never succeed */
                         size_t fail;
                         CF(JMPF, fail);
-                        GGC_WD(node, imm, fail);
+                        ir->imm[i] = fail;
 
                     }
 
@@ -645,7 +2047,7 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
                 {
                     size_t fail;
                     CF(JNEF, fail);
-                    GGC_WD(node, imm, fail);
+                    ir->imm[i] = fail;
                 }
 
                 break;
@@ -654,32 +2056,28 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
             {
                 /* our speculation failed. This is the label target for the associated SPECULATE */
                 size_t fail;
-                fail = GGC_RD(node, left);
-                onode = GGC_RAP(ir, fail);
-                fail = GGC_RD(onode, imm);
+                fail = ir->left[i];
+                fail = ir->imm[fail];
                 L(fail);
                 break;
             }
 
             /* 0-ary: */
             case SDYN_NODE_TOP:
-                IMM64P(RAX, &sdyn_globalObject);
-                C2(MOV, RAX, MEM(8, RAX, 0, RNONE, 0));
+                C2(MOV, RAX, GLOBAL(globalObject));
                 C2(MOV, target, RAX);
                 break;
 
             case SDYN_NODE_NIL:
-                IMM64P(target, &sdyn_undefined);
-                C2(MOV, RAX, MEM(8, target, 0, RNONE, 0));
+                C2(MOV, RAX, GLOBAL(undefined));
                 C2(MOV, target, RAX);
                 break;
 
             case SDYN_NODE_NUM:
-                C2(MOV, target, IMM(GGC_RD(node, imm)));
+                C2(MOV, target, IMM(ir->imm[i]));
                 if (targetType >= SDYN_TYPE_FIRST_BOXED) {
                     C2(MOV, RSI, target);
-                    IMM64P(RAX, &sdyn_boxInt);
-                    JCALL(RAX);
+                    HCALL(sdyn_boxInt);
                     C2(MOV, target, RAX);
                 }
                 break;
@@ -690,11 +2088,11 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
 
                 /* make the string globally accessible */
                 gstring = (SDyn_String *) createPointer();
-                *gstring = GGC_RP(node, immp);
-                *gstring = sdyn_unquote(*gstring);
+                *gstring = sdyn_boxString(NULL, (char *) str, strLen);
+                *gstring = sdyn_intern(NULL, sdyn_unquote(*gstring));
 
                 /* then simply load it */
-                IMM64P(RAX, gstring);
+                RIMM64P(RAX, IMAGE_STRING, gstring);
                 C2(MOV, RAX, MEM(8, RAX, 0, RNONE, 0));
                 C2(MOV, target, RAX);
                 break;
@@ -702,8 +2100,7 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
 
             case SDYN_NODE_FALSE:
                 if (targetType >= SDYN_TYPE_FIRST_BOXED) {
-                    IMM64P(RAX, &sdyn_false);
-                    C2(MOV, RAX, MEM(8, RAX, 0, RNONE, 0));
+                    C2(MOV, RAX, GLOBAL(falseValue));
                     C2(MOV, target, RAX);
                 } else {
                     IMM64(target, 0);
@@ -712,8 +2109,7 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
 
             case SDYN_NODE_TRUE:
                 if (targetType >= SDYN_TYPE_FIRST_BOXED) {
-                    IMM64P(RAX, &sdyn_true);
-                    C2(MOV, RAX, MEM(8, RAX, 0, RNONE, 0));
+                    C2(MOV, RAX, GLOBAL(trueValue));
                     C2(MOV, target, RAX);
                 } else {
                     IMM64(target, 1);
@@ -721,14 +2117,13 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
                 break;
 
             case SDYN_NODE_OBJ:
-                IMM64P(RAX, sdyn_newObject);
-                JCALL(RAX);
+                HCALL(sdyn_newObject);
                 C2(MOV, target, RAX);
                 break;
 
             /* Unary: */
             case SDYN_NODE_ARG:
-                lastArg = GGC_RD(node, imm);
+                lastArg = ir->imm[i];
 
                 /* arguments must be boxed */
                 LOADOP(left, RAX);
@@ -759,8 +2154,7 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
 
                 /* do we need to coerce? */
                 if (leftType != SDYN_TYPE_BOOL) {
-                    IMM64P(RAX, sdyn_toBoolean);
-                    JCALL(RAX);
+                    TOBOOLEAN(leftType);
                     C2(MOV, RSI, RAX);
                 }
 
@@ -769,8 +2163,7 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
 
                 /* and possibly box */
                 if (targetType >= SDYN_TYPE_FIRST_BOXED) {
-                    IMM64P(RAX, sdyn_boxBool);
-                    JCALL(RAX);
+                    HCALL(sdyn_boxBool);
                     C2(MOV, target, RAX);
                 } else {
                     C2(MOV, target, RSI);
@@ -782,8 +2175,7 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
                 BOX(leftType, RSI, left);
 
                 /* just count on sdyn_typeof */
-                IMM64P(RAX, sdyn_typeof);
-                JCALL(RAX);
+                HCALL(sdyn_typeof);
                 C2(MOV, target, RAX);
                 break;
 
@@ -818,10 +2210,65 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
                     /* if the types are the same, we only need to do a
                      * sophisticated equality comparison if they're both
                      * strings or if we only know they're both boxed */
-                    if (leftType == SDYN_TYPE_STRING || leftType == SDYN_TYPE_BOXED) {
+                    if (leftType == SDYN_TYPE_STRING) {
+                        size_t notInterned, same, diffInterned, leftRope,
+                               rightRope, diffLength, leftNoHash,
+                               rightNoHash, sameHash, matched;
+
+                        /* identical strings are equal */
+                        C2(CMP, RSI, RDX);
+                        CF(JEF, same);
+
+                        /* distinct interned strings are different */
+                        C2(CMP, MEM(4, RSI, 0, RNONE, DOFFSET(SDyn_String, interned)), IMM(0));
+                        CF(JEF, notInterned);
+                        C2(CMP, MEM(4, RDX, 0, RNONE, DOFFSET(SDyn_String, interned)), IMM(0));
+                        CF(JNEF, diffInterned);
+                        L(notInterned);
+
+                        /* flat strings of different lengths are different */
+                        C2(MOV, RAX, MEM(8, RSI, 0, RNONE, POFFSET(SDyn_String, value)));
+                        C2(TEST, RAX, RAX);
+                        CF(JEF, leftRope);
+                        C2(MOV, RCX, MEM(8, RDX, 0, RNONE, POFFSET(SDyn_String, value)));
+                        C2(TEST, RCX, RCX);
+                        CF(JEF, rightRope);
+                        C2(MOV, RAX, MEM(8, RAX, 0, RNONE, LENOFFSET));
+                        C2(CMP, RAX, MEM(8, RCX, 0, RNONE, LENOFFSET));
+                        CF(JNEF, diffLength);
+
+                        /* as are strings with different (known) hashes */
+                        C2(MOV, RAX, MEM(8, RSI, 0, RNONE, DOFFSET(SDyn_String, hash)));
+                        C2(TEST, RAX, RAX);
+                        CF(JEF, leftNoHash);
+                        C2(MOV, RCX, MEM(8, RDX, 0, RNONE, DOFFSET(SDyn_String, hash)));
+                        C2(TEST, RCX, RCX);
+                        CF(JEF, rightNoHash);
+                        C2(CMP, RAX, RCX);
+                        CF(JEF, sameHash);
+
+                        L(diffInterned);
+                        L(diffLength);
+                        C2(MOV, RAX, IMM(0));
+                        CF(JMPF, matched);
+
+                        L(same);
+                        C2(MOV, RAX, IMM(1));
+
+                        /* no shortcut, so compare the characters, out of line */
+                        COLD_BEGIN();
+                        COLD_ENTRY(leftRope);
+                        COLD_ENTRY(rightRope);
+                        COLD_ENTRY(leftNoHash);
+                        COLD_ENTRY(rightNoHash);
+                        COLD_ENTRY(sameHash);
+                        HCALL(sdyn_equal);
+                        COLD_END();
+                        L(matched);
+
+                    } else if (leftType == SDYN_TYPE_BOXED) {
                         /* oh well, just use sdyn_equal */
-                        IMM64P(RAX, sdyn_equal);
-                        JCALL(RAX);
+                        HCALL(sdyn_equal);
 
                     } else {
                         size_t eq;
@@ -838,16 +2285,15 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
                 } else {
                     /* types aren't the same, so just box and go */
                     BOX(leftType, RSI, RSI);
-                    C2(MOV, MEM(8, RDI, 0, RNONE, 0), RSI);
+                    C2(MOV, MEM(8, R15, 0, RNONE, 0), RSI);
                     LOADOP(right, RDX);
                     BOX(rightType, RDX, RDX);
-                    C2(MOV, RSI, MEM(8, RDI, 0, RNONE, 0));
-                    IMM64P(RAX, sdyn_equal);
-                    JCALL(RAX);
+                    C2(MOV, RSI, MEM(8, R15, 0, RNONE, 0));
+                    HCALL(sdyn_equal);
 
                 }
 
-                if (GGC_RD(node, op) == SDYN_NODE_NE) {
+                if (ir->op[i] == SDYN_NODE_NE) {
                     /* invert our result */
                     C2(XOR, RAX, IMM(1));
                 }
@@ -855,8 +2301,7 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
                 /* possibly box it */
                 if (targetType >= SDYN_TYPE_FIRST_BOXED) {
                     C2(MOV, RSI, RAX);
-                    IMM64P(RAX, sdyn_boxBool);
-                    JCALL(RAX);
+                    HCALL(sdyn_boxBool);
                 }
 
                 C2(MOV, target, RAX);
@@ -873,7 +2318,7 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
                 size_t after;
 
                 /* get both operands as numbers */
-                intLeft = MEM(8, RBP, 0, RNONE, -16);
+                intLeft = MEM(8, RBP, 0, RNONE, -24);
                 LOADOP(left, RAX);
                 switch (leftType) {
                     case SDYN_TYPE_BOXED_INT:
@@ -891,8 +2336,7 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
                         } else {
                             C2(MOV, RSI, left);
                         }
-                        IMM64P(RAX, sdyn_toNumber);
-                        JCALL(RAX);
+                        TONUMBER(leftType);
                         C2(MOV, intLeft, RAX);
                 }
 
@@ -912,8 +2356,7 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
                         } else {
                             C2(MOV, RSI, right);
                         }
-                        IMM64P(RAX, sdyn_toNumber);
-                        JCALL(RAX);
+                        TONUMBER(rightType);
                         C2(MOV, RDX, RAX);
                 }
                 C2(MOV, RSI, intLeft);
@@ -925,7 +2368,7 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
                 C2(CMP, RSI, RDX);
 
                 /* do the appropriate jump */
-                switch (GGC_RD(node, op)) {
+                switch (ir->op[i]) {
                     case SDYN_NODE_LT: CF(JLF, after); break;
                     case SDYN_NODE_GT: CF(JGF, after); break;
                     case SDYN_NODE_LE: CF(JLEF, after); break;
@@ -940,8 +2383,7 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
 
                 if (targetType >= SDYN_TYPE_FIRST_BOXED) {
                     C2(MOV, RSI, RAX);
-                    IMM64P(RAX, sdyn_boxBool);
-                    JCALL(RAX);
+                    HCALL(sdyn_boxBool);
                 }
 
                 C2(MOV, target, RAX);
@@ -966,30 +2408,25 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
                     switch (leftType) {
                         case SDYN_TYPE_UNDEFINED:
                             /* let the generic case handle it */
-                            IMM64P(RSI, &sdyn_undefined);
-                            C2(MOV, RSI, MEM(8, RSI, 0, RNONE, 0));
+                            C2(MOV, RSI, GLOBAL(undefined));
                             C2(MOV, RDX, RSI);
-                            IMM64P(RAX, sdyn_add);
-                            JCALL(RAX);
+                            HCALL(sdyn_add);
                             break;
 
                         case SDYN_TYPE_BOOL:
                             /* box them and then go to the generic case */
                             C2(MOV, RSI, left);
-                            IMM64P(RAX, sdyn_boxBool);
-                            JCALL(RAX);
-                            C2(MOV, MEM(8, RDI, 0, RNONE, 0), RAX); /* remember boxed left */
+                            HCALL(sdyn_boxBool);
+                            C2(MOV, MEM(8, R15, 0, RNONE, 0), RAX); /* remember boxed left */
                             C2(MOV, RSI, right);
-                            IMM64P(RAX, sdyn_boxBool);
-                            JCALL(RAX);
+                            HCALL(sdyn_boxBool);
 
                             /* put them in the argument slots */
                             C2(MOV, RDX, RAX);
-                            C2(MOV, RSI, MEM(8, RDI, 0, RNONE, 0));
+                            C2(MOV, RSI, MEM(8, R15, 0, RNONE, 0));
 
                             /* and add */
-                            IMM64P(RAX, sdyn_add);
-                            JCALL(RAX);
+                            HCALL(sdyn_add);
                             break;
 
                         case SDYN_TYPE_INT:
@@ -997,8 +2434,7 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
                                 /* may as well box now */
                                 C2(MOV, RSI, left);
                                 C2(ADD, RSI, right);
-                                IMM64P(RAX, sdyn_boxInt);
-                                JCALL(RAX);
+                                HCALL(sdyn_boxInt);
 
                             } else {
                                 /* just add! */
@@ -1021,8 +2457,7 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
 
                             /* rebox the result if asked */
                             if (targetType >= SDYN_TYPE_FIRST_BOXED) {
-                                IMM64P(RAX, sdyn_boxInt);
-                                JCALL(RAX);
+                                HCALL(sdyn_boxInt);
                             }
                             break;
                         }
@@ -1031,8 +2466,7 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
                             /* something boxed, just count on the generic adder */
                             C2(MOV, RSI, left);
                             C2(MOV, RDX, right);
-                            IMM64P(RAX, sdyn_add);
-                            JCALL(RAX);
+                            HCALL(sdyn_add);
                     }
 
                     C2(MOV, target, RAX);
@@ -1040,7 +2474,7 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
                 } else {
                     /* operands are of different types */
                     struct SJA_X8664_Operand boxedLeft;
-                    boxedLeft = MEM(8, RDI, 0, RNONE, 0);
+                    boxedLeft = MEM(8, R15, 0, RNONE, 0);
 
                     /* both sides aren't even the same type, so just box 'em and go */
                     if (leftType >= SDYN_TYPE_FIRST_BOXED) {
@@ -1057,8 +2491,7 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
                         BOX(rightType, RDX, RAX);
                     }
                     C2(MOV, RSI, boxedLeft);
-                    IMM64P(RAX, sdyn_add);
-                    JCALL(RAX);
+                    HCALL(sdyn_add);
 
                     C2(MOV, target, RAX);
 
@@ -1076,11 +2509,29 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
             {
                 struct SJA_X8664_Operand intLeft, result;
                 size_t after;
+                long divisor, magic;
+                int nonNegative, shift;
+
+                /* division by a known constant needn't IDIV, and if the
+                 * dividend is known not to be negative, needn't round towards
+                 * zero */
+                divisor = 0;
+                nonNegative = 0;
+                if (ir->op[i] == SDYN_NODE_MOD || ir->op[i] == SDYN_NODE_DIV) {
+                    uidx = ir->uidx[ir->right[i]];
+                    if (SDYN_TYPE_INTEGRAL(ir->rtype[uidx]) &&
+                        ir->rangeMin[uidx] == ir->rangeMax[uidx] &&
+                        ir->rangeMin[uidx] >= 2 && ir->rangeMin[uidx] < 0x80000000L)
+                        divisor = ir->rangeMin[uidx];
+
+                    uidx = ir->uidx[ir->left[i]];
+                    nonNegative = SDYN_TYPE_INTEGRAL(ir->rtype[uidx]) && ir->rangeMin[uidx] >= 0;
+                }
 
                 /* left -> RAX, right -> RSI */
 
                 /* get both operands as numbers */
-                intLeft = MEM(8, RBP, 0, RNONE, -16);
+                intLeft = MEM(8, RBP, 0, RNONE, -24);
                 LOADOP(left, RAX);
                 switch (leftType) {
                     case SDYN_TYPE_BOXED_INT:
@@ -1098,52 +2549,111 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
                         } else {
                             C2(MOV, RSI, left);
                         }
-                        IMM64P(RAX, sdyn_toNumber);
-                        JCALL(RAX);
+                        TONUMBER(leftType);
                         C2(MOV, intLeft, RAX);
                         break;
                 }
 
-                LOADOP(right, RSI);
-                switch (rightType) {
-                    case SDYN_TYPE_BOXED_INT:
-                        C2(MOV, RSI, MEM(8, right, 0, RNONE, 8));
-                        break;
+                if (!divisor) {
+                    LOADOP(right, RSI);
+                    switch (rightType) {
+                        case SDYN_TYPE_BOXED_INT:
+                            C2(MOV, RSI, MEM(8, right, 0, RNONE, 8));
+                            break;
 
-                    case SDYN_TYPE_INT:
-                        break;
+                        case SDYN_TYPE_INT:
+                            break;
 
-                    default:
-                        if (rightType < SDYN_TYPE_FIRST_BOXED)
-                            BOX(rightType, RSI, right);
-                        IMM64P(RAX, sdyn_toNumber);
-                        JCALL(RAX);
-                        C2(MOV, RSI, RAX);
-                        break;
+                        default:
+                            if (rightType < SDYN_TYPE_FIRST_BOXED)
+                                BOX(rightType, RSI, right);
+                            TONUMBER(rightType);
+                            C2(MOV, RSI, RAX);
+                            break;
+                    }
                 }
                 C2(MOV, RAX, intLeft);
 
                 /* do the appropriate operation */
-                switch (GGC_RD(node, op)) {
+                switch (ir->op[i]) {
                     case SDYN_NODE_SUB: C2(SUB, RAX, RSI); result = RAX; break;
                     case SDYN_NODE_MUL: C2(IMUL, RAX, RSI); result = RAX; break;
 
                     case SDYN_NODE_MOD:
                     case SDYN_NODE_DIV:
-                        C2(XOR, RDX, RDX);
-                        C1(IDIV, RSI);
-                        if (GGC_RD(node, op) == SDYN_NODE_MOD)
+                        if (divisor && !(divisor & (divisor - 1))) {
+                            /* a power of two, so just shift or mask */
+                            for (shift = 0; (1L << shift) != divisor; shift++);
+                            if (nonNegative) {
+                                if (ir->op[i] == SDYN_NODE_MOD)
+                                    C2(AND, RAX, IMM(divisor - 1));
+                                else
+                                    C2(SAR, RAX, IMM(shift));
+                                result = RAX;
+
+                            } else {
+                                /* bias negative dividends to round towards zero */
+                                C2(MOV, RDX, RAX);
+                                C2(SAR, RDX, IMM(63));
+                                C2(SHR, RDX, IMM(64 - shift));
+                                C2(ADD, RDX, RAX);
+                                if (ir->op[i] == SDYN_NODE_MOD) {
+                                    C2(AND, RDX, IMM(-divisor));
+                                    C2(SUB, RAX, RDX);
+                                    result = RAX;
+                                } else {
+                                    C2(SAR, RDX, IMM(shift));
+                                    result = RDX;
+                                }
+
+                            }
+
+                        } else if (divisor) {
+                            /* multiply by the reciprocal, taking the high half */
+                            divMagic(divisor, &magic, &shift);
+                            C2(MOV, RCX, RAX);
+                            IMM64(RAX, magic);
+                            C1(IMUL, RCX);
+                            if (magic < 0)
+                                C2(ADD, RDX, RCX);
+                            if (shift)
+                                C2(SAR, RDX, IMM(shift));
+                            if (!nonNegative) {
+                                /* round negative quotients towards zero */
+                                C2(MOV, RAX, RCX);
+                                C2(SHR, RAX, IMM(63));
+                                C2(ADD, RDX, RAX);
+                            }
+                            if (ir->op[i] == SDYN_NODE_MOD) {
+                                C2(MOV, RAX, IMM(divisor));
+                                C2(IMUL, RAX, RDX);
+                                C2(MOV, RDX, RCX);
+                                C2(SUB, RDX, RAX);
+                            }
                             result = RDX;
-                        else
-                            result = RAX;
+
+                        } else {
+                            /* IDIV divides RDX:RAX, so sign-extend into RDX */
+                            if (nonNegative) {
+                                C2(XOR, RDX, RDX);
+                            } else {
+                                C2(MOV, RDX, RAX);
+                                C2(SAR, RDX, IMM(63));
+                            }
+                            C1(IDIV, RSI);
+                            if (ir->op[i] == SDYN_NODE_MOD)
+                                result = RDX;
+                            else
+                                result = RAX;
+
+                        }
                         break;
                 }
 
                 /* and return */
                 if (targetType >= SDYN_TYPE_FIRST_BOXED) {
                     C2(MOV, RSI, result);
-                    IMM64P(RAX, sdyn_boxInt);
-                    JCALL(RAX);
+                    HCALL(sdyn_boxInt);
                     C2(MOV, target, RAX);
                 } else {
                     C2(MOV, target, result);
@@ -1156,25 +2666,70 @@ sdyn_native_function_t sdyn_compile(SDyn_IRNodeArray ir)
             case SDYN_NODE_UNIFY: break;
 
             default:
-                fprintf(stderr, "Unsupported operation %s!\n", sdyn_nodeNames[GGC_RD(node, op)]);
+                fprintf(stderr, "Unsupported operation %s!\n", sdyn_nodeNames[ir->op[i]]);
                 unsuppCount++;
         }
     }
 
     if (unsuppCount) abort();
 
-    /* now transfer it to executable memory */
+    /* put the cold stubs after the body, making the jumps into each one and
+     * the jump back out. Their helper calls and relocations move with them. */
+    {
+        struct ColdStub *stub;
+        size_t j, k, c, r, len;
+
+        for (j = k = c = r = 0; j < coldStubs.bufused; j++) {
+            stub = &coldStubs.buf[j];
+            for (; k < coldEntries.bufused && coldEntries.buf[k] == j; k += 2)
+                sja_patchFrel(&buf, coldEntries.buf[k + 1]);
+
+            for (; c < coldCalls.bufused && coldCalls.buf[c] < stub->end; c += 2) {
+                while (BUFFER_SPACE(hotCalls) < 2) EXPAND_BUFFER(hotCalls);
+                hotCalls.buf[hotCalls.bufused++] = buf.bufused + coldCalls.buf[c] - stub->start;
+                hotCalls.buf[hotCalls.bufused++] = coldCalls.buf[c + 1];
+            }
+
+            for (; r < coldRelocs.bufused && coldRelocs.buf[r] < stub->end; r += 4) {
+                while (BUFFER_SPACE(hotRelocs) < 4) EXPAND_BUFFER(hotRelocs);
+                hotRelocs.buf[hotRelocs.bufused++] = buf.bufused + coldRelocs.buf[r] - stub->start;
+                hotRelocs.buf[hotRelocs.bufused++] = coldRelocs.buf[r + 1];
+                hotRelocs.buf[hotRelocs.bufused++] = coldRelocs.buf[r + 2];
+                hotRelocs.buf[hotRelocs.bufused++] = coldRelocs.buf[r + 3];
+            }
+
+            len = stub->end - stub->start;
+            while (BUFFER_SPACE(buf) < len) EXPAND_BUFFER(buf);
+            memcpy(BUFFER_END(buf), cold.buf + stub->start, len);
+            buf.bufused += len;
+            sja_compile(OP1(JMPR, RREL(stub->resume)), &buf, NULL);
+        }
+    }
+
+    /* now transfer it to executable memory, and perhaps make an image */
     {
-        size_t sz = (buf.bufused + 4095) / 4096 * 4096;
         unsigned char *retMap;
 
-        retMap = mmap(NULL, sz, PROT_READ|PROT_WRITE|PROT_EXEC, MAP_PRIVATE|MAP_ANON, -1, 0);
-        memcpy(retMap, buf.buf, buf.bufused);
+        if (image)
+            *image = makeImage(ir, &buf, hasFast ? fastOffset + 1 : 0,
+                &hotCalls, &hotRelocs, imageLen);
+
+        retMap = placeCode(buf.buf, buf.bufused, hotCalls.buf, hotCalls.bufused / 2);
+
         ret = (sdyn_native_function_t) retMap;
+        if (fastEntry)
+            *fastEntry = hasFast ? (void *) (retMap + fastOffset) : NULL;
     }
 
     FREE_BUFFER(buf);
     FREE_BUFFER(returns);
+    FREE_BUFFER(cold);
+    FREE_BUFFER(coldEntries);
+    FREE_BUFFER(coldStubs);
+    FREE_BUFFER(hotCalls);
+    FREE_BUFFER(coldCalls);
+    FREE_BUFFER(hotRelocs);
+    FREE_BUFFER(coldRelocs);
 
     return ret;
 }
@@ -35,9 +35,10 @@
 #ifdef USE_SDYN_JIT_TEST
 int main()
 {
-    SDyn_Node pnode = NULL, cnode = NULL;
-    SDyn_NodeArray children = NULL;
-    SDyn_IRNodeArray ir = NULL;
+    struct SDyn_Arena arena;
+    struct SDyn_Node *pnode, *cnode;
+    struct SDyn_NodeArray *children;
+    struct SDyn_IR *ir;
     sdyn_native_function_t func;
     size_t i, addr;
     struct Buffer_char buf;
@@ -49,20 +50,19 @@ int main()
     cur = (unsigned char *) buf.buf;
 
     sdyn_initValues();
+    sdyn_arenaInit(&arena);
 
-    GGC_PUSH_4(pnode, cnode, children, ir);
-
-    pnode = sdyn_parse(cur);
-    children = GGC_RP(pnode, children);
+    pnode = sdyn_parse(&arena, cur);
+    children = pnode->children;
 
     /* output symbols */
     printf("$$ jit-output\n");
     addr = 0;
     for (i = 0; i < children->length; i++) {
-        cnode = GGC_RAP(children, i);
-        if (GGC_RD(cnode, type) == SDYN_NODE_FUNDECL) {
+        cnode = children->a[i];
+        if (cnode->type == SDYN_NODE_FUNDECL) {
             printf("  %.*s $%lx\n",
-                   (int) GGC_RD(cnode, tok).valLen, (char *) GGC_RD(cnode, tok).val,
+                   (int) cnode->tok.valLen, (char *) cnode->tok.val,
                    (unsigned long) addr);
             addr += 4096;
         }
@@ -94,14 +94,14 @@ int main()
     /* and output data */
     addr = 0;
     for (i = 0; i < children->length; i++) {
-        cnode = GGC_RAP(children, i);
-        if (GGC_RD(cnode, type) == SDYN_NODE_FUNDECL) {
+        cnode = children->a[i];
+        if (cnode->type == SDYN_NODE_FUNDECL) {
             unsigned char *dp;
             size_t faddr, afaddr, laddr;
             unsigned char csum;
 
-            ir = sdyn_irCompile(cnode, NULL);
-            func = sdyn_compile(ir);
+            ir = sdyn_irCompile(&arena, cnode, NULL, NULL);
+            func = sdyn_compile(ir, NULL, NULL, NULL);
             dp = (unsigned char *) (void *) func;
 
             for (faddr = 0; faddr < 4096; faddr += 128) {
@@ -123,6 +123,8 @@ int main()
         }
     }
 
+    sdyn_arenaFree(&arena);
+
     return 0;
 }
 #endif
@@ -16,13 +16,12 @@
  * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <setjmp.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 
-#include "ggggc/gc.h"
-#include "ggggc/collections/list.h"
-
 #include "sdyn/nodes.h"
 #include "sdyn/parser.h"
 #include "sdyn/tokenizer.h"
@@ -46,7 +45,11 @@ char *sdyn_nodeNames[] = {
 
 #define IFNOTTOK(ttype) if (tok.type != SDYN_TOKEN_ ## ttype)
 
+/* if set, errors jump here instead of aborting */
+static jmp_buf *parseFailure;
+
 #define ERROR() do { \
+    if (parseFailure) longjmp(*parseFailure, 1); \
     fprintf(stderr, "Unrecoverable error at token %.*s\n", (int) tok.valLen, (char *) tok.val); \
     abort(); \
 } while(0)
@@ -59,19 +62,55 @@ char *sdyn_nodeNames[] = {
 } while(0)
 
 #define RET(ttype, tokv, childrenv) do { \
-    struct SDyn_Token tokvw; \
-    ret = GGC_NEW(SDyn_Node); \
-    GGC_WD(ret, type, SDYN_NODE_ ## ttype); \
-    tokvw = (tokv); \
-    GGC_WD(ret, tok, tokvw); \
-    GGC_WP(ret, children, childrenv); \
+    ret = sdyn_arenaAlloc(arena, sizeof(struct SDyn_Node)); \
+    ret->type = SDYN_NODE_ ## ttype; \
+    ret->tok = (tokv); \
+    ret->children = (childrenv); \
 } while(0)
 
-GGC_LIST(SDyn_Node)
+/* a growable list of nodes, for building node arrays */
+struct NodeList {
+    size_t length, capacity;
+    struct SDyn_Node **nodes;
+};
+
+static void nodeListInit(struct NodeList *list)
+{
+    list->length = list->capacity = 0;
+    list->nodes = NULL;
+}
+
+static void nodeListPush(struct SDyn_Arena *arena, struct NodeList *list, struct SDyn_Node *node)
+{
+    if (list->length >= list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 8;
+        list->nodes = sdyn_arenaRealloc(arena, list->nodes,
+            list->capacity * sizeof(struct SDyn_Node *),
+            capacity * sizeof(struct SDyn_Node *));
+        list->capacity = capacity;
+    }
+    list->nodes[list->length++] = node;
+}
+
+static struct SDyn_NodeArray *newNodeArray(struct SDyn_Arena *arena, size_t length)
+{
+    struct SDyn_NodeArray *ret = sdyn_arenaAlloc(arena,
+        sizeof(struct SDyn_NodeArray) + length * sizeof(struct SDyn_Node *));
+    ret->length = length;
+    return ret;
+}
+
+static struct SDyn_NodeArray *nodeListToArray(struct SDyn_Arena *arena, struct NodeList *list)
+{
+    struct SDyn_NodeArray *ret = newNodeArray(arena, list->length);
+    memcpy(ret->a, list->nodes, list->length * sizeof(struct SDyn_Node *));
+    return ret;
+}
 
-#define PARSER(name) static SDyn_Node parse ## name (struct SDyn_Token *ntok)
-PARSER(Top);
+#define PARSER(name) static struct SDyn_Node *parse ## name (struct SDyn_Arena *arena, struct SDyn_Token *ntok)
+static struct SDyn_Node *parseTop(struct SDyn_Arena *arena, struct SDyn_Token *ntok, int lazy);
 PARSER(FunDecl);
+PARSER(LazyFunDecl);
 PARSER(VarDecl);
 PARSER(GlobalCall);
 PARSER(Params);
@@ -93,22 +132,51 @@ PARSER(Args);
 PARSER(Primary);
 
 /* the parser entry point */
-SDyn_Node sdyn_parse(const unsigned char *inp)
+struct SDyn_Node *sdyn_parse(struct SDyn_Arena *arena, const unsigned char *inp)
 {
     struct SDyn_Token ntok = sdyn_tokenize(inp);
-    return parseTop(&ntok);
+    return parseTop(arena, &ntok, 0);
 }
 
-PARSER(Top)
+/* the pre-parser entry point */
+struct SDyn_Node *sdyn_preparse(struct SDyn_Arena *arena, const unsigned char *inp)
 {
-    struct SDyn_Token tok, first;
-    SDyn_Node ret = NULL, cur = NULL;
-    SDyn_NodeArray children = NULL;
-    SDyn_NodeList clist = NULL;
+    struct SDyn_Token ntok = sdyn_tokenize(inp);
+    return parseTop(arena, &ntok, 1);
+}
 
-    GGC_PUSH_4(ret, cur, children, clist);
+/* parse a single function declaration, as found by the pre-parser */
+struct SDyn_Node *sdyn_parseFunction(struct SDyn_Arena *arena, const unsigned char *inp)
+{
+    struct SDyn_Token ntok = sdyn_tokenize(inp);
+    return parseFunDecl(arena, &ntok);
+}
+
+/* parse a single function declaration, or return NULL if it has an error */
+struct SDyn_Node *sdyn_tryParseFunction(struct SDyn_Arena *arena, const unsigned char *inp)
+{
+    struct SDyn_Token ntok = sdyn_tokenize(inp);
+    jmp_buf failure;
+    struct SDyn_Node *ret;
+
+    if (setjmp(failure)) {
+        parseFailure = NULL;
+        return NULL;
+    }
+    parseFailure = &failure;
+    ret = parseFunDecl(arena, &ntok);
+    parseFailure = NULL;
+    return ret;
+}
+
+static struct SDyn_Node *parseTop(struct SDyn_Arena *arena, struct SDyn_Token *ntok, int lazy)
+{
+    struct SDyn_Token tok, first;
+    struct SDyn_Node *ret = NULL, *cur = NULL;
+    struct SDyn_NodeArray *children = NULL;
+    struct NodeList clist;
 
-    clist = GGC_NEW(SDyn_NodeList);
+    nodeListInit(&clist);
     PEEK();
     first = tok;
 
@@ -116,120 +184,152 @@ PARSER(Top)
         PEEK();
 
         IFTOK(function) {
-            cur = parseFunDecl(ntok);
+            if (lazy)
+                cur = parseLazyFunDecl(arena, ntok);
+            else
+                cur = parseFunDecl(arena, ntok);
         } else IFTOK(var) {
-            cur = parseVarDecl(ntok);
+            cur = parseVarDecl(arena, ntok);
         } else IFTOK(ID) {
-            cur = parseGlobalCall(ntok);
+            cur = parseGlobalCall(arena, ntok);
         } else IFTOK(EOF) {
             break;
         } else ERROR();
 
-        SDyn_NodeListPush(clist, cur);
+        nodeListPush(arena, &clist, cur);
     }
 
     /* now build the return */
-    children = SDyn_NodeListToArray(clist);
+    children = nodeListToArray(arena, &clist);
     RET(TOP, first, children);
     return ret;
 }
 
 PARSER(GlobalCall)
 {
-    SDyn_Node ret = NULL;
+    struct SDyn_Node *ret = NULL;
     struct SDyn_Token tok, id;
 
-    GGC_PUSH_1(ret);
-
     ASSERTNEXT(ID);
     id = tok;
     ASSERTNEXT(LPAREN);
     ASSERTNEXT(RPAREN);
     ASSERTNEXT(SEMICOLON);
 
-    RET(GLOBALCALL, id, GGC_NULL);
+    RET(GLOBALCALL, id, NULL);
     return ret;
 }
 
 PARSER(FunDecl)
 {
-    SDyn_Node ret = NULL, params = NULL, varDecls = NULL, statements = NULL;
-    SDyn_NodeArray children = NULL;
+    struct SDyn_Node *ret = NULL, *params = NULL, *varDecls = NULL, *statements = NULL;
+    struct SDyn_NodeArray *children = NULL;
     struct SDyn_Token tok, id;
 
-    GGC_PUSH_5(ret, params, varDecls, statements, children);
-
     ASSERTNEXT(function);
     ASSERTNEXT(ID);
     id = tok;
     ASSERTNEXT(LPAREN);
-    params = parseParams(ntok);
+    params = parseParams(arena, ntok);
     ASSERTNEXT(RPAREN);
     ASSERTNEXT(LBRACE);
-    varDecls = parseVarDecls(ntok);
-    statements = parseStatements(ntok);
+    varDecls = parseVarDecls(arena, ntok);
+    statements = parseStatements(arena, ntok);
     ASSERTNEXT(RBRACE);
 
-    children = GGC_NEW_PA(SDyn_Node, 3);
-    GGC_WAP(children, 0, params);
-    GGC_WAP(children, 1, varDecls);
-    GGC_WAP(children, 2, statements);
+    children = newNodeArray(arena, 3);
+    children->a[0] = params;
+    children->a[1] = varDecls;
+    children->a[2] = statements;
     RET(FUNDECL, id, children);
 
     return ret;
 }
 
+/* pre-parse a function: parse its header, but only skip its body */
+PARSER(LazyFunDecl)
+{
+    struct SDyn_Node *ret = NULL, *source = NULL;
+    struct SDyn_NodeArray *children = NULL;
+    struct SDyn_Token tok, start, id, range;
+    size_t depth;
+
+    ASSERTNEXT(function);
+    start = tok;
+    ASSERTNEXT(ID);
+    id = tok;
+    ASSERTNEXT(LPAREN);
+    parseParams(arena, ntok);
+    ASSERTNEXT(RPAREN);
+    ASSERTNEXT(LBRACE);
+
+    /* skip to the matching brace */
+    for (depth = 1; depth; ) {
+        NEXT();
+        IFTOK(LBRACE) depth++;
+        else IFTOK(RBRACE) depth--;
+        else IFTOK(EOF) ERROR();
+        else IFTOK(ERR) ERROR();
+    }
+
+    /* the source range covers the whole declaration */
+    range = start;
+    range.valLen = (tok.val + tok.valLen) - start.val;
+    RET(SOURCE, range, NULL);
+    source = ret;
+
+    children = newNodeArray(arena, 1);
+    children->a[0] = source;
+    RET(LAZYFUNDECL, id, children);
+
+    return ret;
+}
+
 PARSER(VarDecls)
 {
-    SDyn_Node ret = NULL, cur = NULL;
-    SDyn_NodeArray children = NULL;
-    SDyn_NodeList clist = NULL;
+    struct SDyn_Node *ret = NULL, *cur = NULL;
+    struct SDyn_NodeArray *children = NULL;
+    struct NodeList clist;
     struct SDyn_Token tok, first;
 
-    GGC_PUSH_4(ret, cur, children, clist);
-
-    clist = GGC_NEW(SDyn_NodeList);
+    nodeListInit(&clist);
     PEEK();
     first = tok;
 
     while (1) {
         PEEK();
         IFNOTTOK(var) break;
-        cur = parseVarDecl(ntok);
-        SDyn_NodeListPush(clist, cur);
+        cur = parseVarDecl(arena, ntok);
+        nodeListPush(arena, &clist, cur);
     }
 
-    children = SDyn_NodeListToArray(clist);
+    children = nodeListToArray(arena, &clist);
     RET(VARDECLS, first, children);
     return ret;
 }
 
 PARSER(VarDecl)
 {
-    SDyn_Node ret = NULL;
+    struct SDyn_Node *ret = NULL;
     struct SDyn_Token tok, id;
 
-    GGC_PUSH_1(ret);
-
     ASSERTNEXT(var);
     ASSERTNEXT(ID);
     id = tok;
     ASSERTNEXT(SEMICOLON);
 
-    RET(VARDECL, id, GGC_NULL);
+    RET(VARDECL, id, NULL);
     return ret;
 }
 
 PARSER(Params)
 {
-    SDyn_Node ret = NULL;
-    SDyn_NodeArray children = NULL;
-    SDyn_NodeList clist = NULL;
+    struct SDyn_Node *ret = NULL;
+    struct SDyn_NodeArray *children = NULL;
+    struct NodeList clist;
     struct SDyn_Token tok, first;
 
-    GGC_PUSH_3(ret, children, clist);
-
-    clist = GGC_NEW(SDyn_NodeList);
+    nodeListInit(&clist);
     PEEK();
     first = tok;
 
@@ -238,8 +338,8 @@ PARSER(Params)
         NEXT();
 
         /* yes. Add it */
-        RET(PARAM, tok, GGC_NULL);
-        SDyn_NodeListPush(clist, ret);
+        RET(PARAM, tok, NULL);
+        nodeListPush(arena, &clist, ret);
 
         /* now look for more */
         while (1) {
@@ -248,28 +348,26 @@ PARSER(Params)
             IFTOK(COMMA) {
                 NEXT();
                 ASSERTNEXT(ID);
-                RET(PARAM, tok, GGC_NULL);
-                SDyn_NodeListPush(clist, ret);
+                RET(PARAM, tok, NULL);
+                nodeListPush(arena, &clist, ret);
             } else break;
         }
     }
 
     /* and prepare the return */
-    children = SDyn_NodeListToArray(clist);
+    children = nodeListToArray(arena, &clist);
     RET(PARAMS, first, children);
     return ret;
 }
 
 PARSER(Statements)
 {
-    SDyn_Node ret = NULL;
-    SDyn_NodeArray children = NULL;
-    SDyn_NodeList clist = NULL;
+    struct SDyn_Node *ret = NULL;
+    struct SDyn_NodeArray *children = NULL;
+    struct NodeList clist;
     struct SDyn_Token tok, first;
 
-    GGC_PUSH_3(ret, children, clist);
-
-    clist = GGC_NEW(SDyn_NodeList);
+    nodeListInit(&clist);
     PEEK();
     first = tok;
 
@@ -277,23 +375,21 @@ PARSER(Statements)
         /* the only token that cannot be a statement is } */
         PEEK();
         IFTOK(RBRACE) break;
-        ret = parseStatement(ntok);
-        SDyn_NodeListPush(clist, ret);
+        ret = parseStatement(arena, ntok);
+        nodeListPush(arena, &clist, ret);
     }
 
-    children = SDyn_NodeListToArray(clist);
+    children = nodeListToArray(arena, &clist);
     RET(STATEMENTS, first, children);
     return ret;
 }
 
 PARSER(Statement)
 {
-    SDyn_Node ret = NULL;
-    SDyn_NodeArray children = NULL;
+    struct SDyn_Node *ret = NULL;
+    struct SDyn_NodeArray *children = NULL;
     struct SDyn_Token tok, rep;
 
-    GGC_PUSH_2(ret, children);
-
     PEEK();
 
     IFTOK(if) {
@@ -301,17 +397,17 @@ PARSER(Statement)
 
         /* if statement */
         rep = tok;
-        children = GGC_NEW_PA(SDyn_Node, 3);
+        children = newNodeArray(arena, 3);
         ASSERTNEXT(LPAREN);
-        ret = parseExpression(ntok);
-        GGC_WAP(children, 0, ret);
+        ret = parseExpression(arena, ntok);
+        children->a[0] = ret;
         ASSERTNEXT(RPAREN);
         ASSERTNEXT(LBRACE);
-        ret = parseStatements(ntok);
-        GGC_WAP(children, 1, ret);
+        ret = parseStatements(arena, ntok);
+        children->a[1] = ret;
         ASSERTNEXT(RBRACE);
-        ret = parseElseClause(ntok);
-        GGC_WAP(children, 2, ret);
+        ret = parseElseClause(arena, ntok);
+        children->a[2] = ret;
         RET(IF, rep, children);
         return ret;
 
@@ -320,14 +416,14 @@ PARSER(Statement)
 
         /* while statement */
         rep = tok;
-        children = GGC_NEW_PA(SDyn_Node, 2);
+        children = newNodeArray(arena, 2);
         ASSERTNEXT(LPAREN);
-        ret = parseExpression(ntok);
-        GGC_WAP(children, 0, ret);
+        ret = parseExpression(arena, ntok);
+        children->a[0] = ret;
         ASSERTNEXT(RPAREN);
         ASSERTNEXT(LBRACE);
-        ret = parseStatements(ntok);
-        GGC_WAP(children, 1, ret);
+        ret = parseStatements(arena, ntok);
+        children->a[1] = ret;
         ASSERTNEXT(RBRACE);
         RET(WHILE, rep, children);
         return ret;
@@ -337,16 +433,16 @@ PARSER(Statement)
 
         /* return statement */
         rep = tok;
-        children = GGC_NEW_PA(SDyn_Node, 1);
-        ret = parseExpression(ntok);
-        GGC_WAP(children, 0, ret);
+        children = newNodeArray(arena, 1);
+        ret = parseExpression(arena, ntok);
+        children->a[0] = ret;
         ASSERTNEXT(SEMICOLON);
         RET(RETURN, rep, children);
         return ret;
 
     } else {
         /* expression statement */
-        ret = parseExpression(ntok);
+        ret = parseExpression(arena, ntok);
         ASSERTNEXT(SEMICOLON);
         return ret;
 
@@ -355,16 +451,14 @@ PARSER(Statement)
 
 PARSER(ElseClause)
 {
-    SDyn_Node ret = NULL;
+    struct SDyn_Node *ret = NULL;
     struct SDyn_Token tok;
 
-    GGC_PUSH_1(ret);
-
     PEEK();
     IFTOK(else) {
         NEXT();
         ASSERTNEXT(LBRACE);
-        ret = parseStatements(ntok);
+        ret = parseStatements(arena, ntok);
         ASSERTNEXT(RBRACE);
     }
 
@@ -373,13 +467,11 @@ PARSER(ElseClause)
 
 PARSER(Expression)
 {
-    SDyn_Node ret = NULL, left = NULL, right = NULL;
-    SDyn_NodeArray children = NULL;
+    struct SDyn_Node *ret = NULL, *left = NULL, *right = NULL;
+    struct SDyn_NodeArray *children = NULL;
     struct SDyn_Token tok, rep;
 
-    GGC_PUSH_4(ret, left, right, children);
-
-    left = parseLValOpt(ntok);
+    left = parseLValOpt(arena, ntok);
     if (left) {
         /* the left appeared to be a valid lvalue, is this an assignment? */
         PEEK();
@@ -387,10 +479,10 @@ PARSER(Expression)
             /* it is */
             NEXT();
             rep = tok;
-            right = parseExpression(ntok);
-            children = GGC_NEW_PA(SDyn_Node, 2);
-            GGC_WAP(children, 0, left);
-            GGC_WAP(children, 1, right);
+            right = parseExpression(arena, ntok);
+            children = newNodeArray(arena, 2);
+            children->a[0] = left;
+            children->a[1] = right;
             RET(ASSIGN, rep, children);
             return ret;
 
@@ -402,18 +494,17 @@ PARSER(Expression)
 
     } else {
         /* no, must be some other kind of expression */
-        return parseOrExp(ntok);
+        return parseOrExp(arena, ntok);
 
     }
 }
 
 #define BINARY_HEAD(name, sub) \
 PARSER(name) { \
-    SDyn_Node ret = NULL, right = NULL; \
-    SDyn_NodeArray children = NULL; \
+    struct SDyn_Node *ret = NULL, *right = NULL; \
+    struct SDyn_NodeArray *children = NULL; \
     struct SDyn_Token tok, rep; \
-    GGC_PUSH_3(ret, right, children); \
-    ret = parse ## sub(ntok); \
+    ret = parse ## sub(arena, ntok); \
     while (1) { \
         PEEK();
 
@@ -421,10 +512,10 @@ PARSER(name) { \
     IFTOK(ttype) { \
         NEXT(); \
         rep = tok; \
-        right = parse ## sub(ntok); \
-        children = GGC_NEW_PA(SDyn_Node, 2); \
-        GGC_WAP(children, 0, ret); \
-        GGC_WAP(children, 1, right); \
+        right = parse ## sub(arena, ntok); \
+        children = newNodeArray(arena, 2); \
+        children->a[0] = ret; \
+        children->a[1] = right; \
         RET(ntype, rep, children); \
     } else
 
@@ -466,12 +557,10 @@ BINARY_TAIL
 
 PARSER(PrefixExp)
 {
-    SDyn_Node ret = NULL, left = NULL, right = NULL;
-    SDyn_NodeArray children = NULL;
+    struct SDyn_Node *ret = NULL, *left = NULL, *right = NULL;
+    struct SDyn_NodeArray *children = NULL;
     struct SDyn_Token tok, rep;
 
-    GGC_PUSH_4(ret, left, right, children);
-
     PEEK();
     IFTOK(BNOT) {
         NEXT();
@@ -479,15 +568,15 @@ PARSER(PrefixExp)
         /* ~ ~ ( MulExp / PrefixExp ) */
         ASSERTNEXT(BNOT);
         ASSERTNEXT(LPAREN);
-        left = parseMulExp(ntok);
+        left = parseMulExp(arena, ntok);
         ASSERTNEXT(DIV);
         rep = tok;
-        right = parsePrefixExp(ntok);
+        right = parsePrefixExp(arena, ntok);
         ASSERTNEXT(RPAREN);
 
-        children = GGC_NEW_PA(SDyn_Node, 2);
-        GGC_WAP(children, 0, left);
-        GGC_WAP(children, 1, right);
+        children = newNodeArray(arena, 2);
+        children->a[0] = left;
+        children->a[1] = right;
 
         RET(DIV, rep, children);
         return ret;
@@ -497,9 +586,9 @@ PARSER(PrefixExp)
 
         /* ! PrefixExp */
         rep = tok;
-        ret = parsePrefixExp(ntok);
-        children = GGC_NEW_PA(SDyn_Node, 1);
-        GGC_WAP(children, 0, ret);
+        ret = parsePrefixExp(arena, ntok);
+        children = newNodeArray(arena, 1);
+        children->a[0] = ret;
         RET(NOT, rep, children);
         return ret;
 
@@ -508,25 +597,23 @@ PARSER(PrefixExp)
 
         /* typeof PrefixExp */
         rep = tok;
-        ret = parsePrefixExp(ntok);
-        children = GGC_NEW_PA(SDyn_Node, 1);
-        GGC_WAP(children, 0, ret);
+        ret = parsePrefixExp(arena, ntok);
+        children = newNodeArray(arena, 1);
+        children->a[0] = ret;
         RET(TYPEOF, rep, children);
         return ret;
 
     }
 
-    return parsePostfixExp(ntok);
+    return parsePostfixExp(arena, ntok);
 }
 
 PARSER(PostfixExp)
 {
-    SDyn_Node ret = NULL, right = NULL;
-    SDyn_NodeArray children = NULL;
+    struct SDyn_Node *ret = NULL, *right = NULL;
+    struct SDyn_NodeArray *children = NULL;
     struct SDyn_Token tok, id, rep;
 
-    GGC_PUSH_3(ret, right, children);
-
     PEEK();
 
     /* only special case is an intrinsic call */
@@ -536,14 +623,14 @@ PARSER(PostfixExp)
 
         /* <intrinsic> ( Args ) */
         ASSERTNEXT(LPAREN);
-        ret = parseArgs(ntok);
+        ret = parseArgs(arena, ntok);
         ASSERTNEXT(RPAREN);
-        children = GGC_NEW_PA(SDyn_Node, 1);
-        GGC_WAP(children, 0, ret);
+        children = newNodeArray(arena, 1);
+        children->a[0] = ret;
         RET(INTRINSICCALL, id, children);
 
     } else {
-        ret = parsePrimary(ntok);
+        ret = parsePrimary(arena, ntok);
 
     }
 
@@ -556,11 +643,11 @@ PARSER(PostfixExp)
 
             /* PostfixExp ( Args ) */
             rep = tok;
-            right = parseArgs(ntok);
+            right = parseArgs(arena, ntok);
             ASSERTNEXT(RPAREN);
-            children = GGC_NEW_PA(SDyn_Node, 2);
-            GGC_WAP(children, 0, ret);
-            GGC_WAP(children, 1, right);
+            children = newNodeArray(arena, 2);
+            children->a[0] = ret;
+            children->a[1] = right;
             RET(CALL, rep, children);
 
         } else IFTOK(LBRACKET) {
@@ -568,11 +655,11 @@ PARSER(PostfixExp)
 
             /* PostfixExp [ Expression ] */
             rep = tok;
-            right = parseExpression(ntok);
+            right = parseExpression(arena, ntok);
             ASSERTNEXT(RBRACKET);
-            children = GGC_NEW_PA(SDyn_Node, 2);
-            GGC_WAP(children, 0, ret);
-            GGC_WAP(children, 1, right);
+            children = newNodeArray(arena, 2);
+            children->a[0] = ret;
+            children->a[1] = right;
             RET(INDEX, rep, children);
 
         } else IFTOK(DOT) {
@@ -581,8 +668,8 @@ PARSER(PostfixExp)
             /* PostfixExp . <id> */
             ASSERTNEXT(ID);
             id = tok;
-            children = GGC_NEW_PA(SDyn_Node, 1);
-            GGC_WAP(children, 0, ret);
+            children = newNodeArray(arena, 1);
+            children->a[0] = ret;
             RET(MEMBER, id, children);
 
         } else break;
@@ -594,20 +681,18 @@ PARSER(PostfixExp)
 /* LVals are really just a special case of OrExps, grammatically */
 PARSER(LValOpt)
 {
-    SDyn_Node ret = NULL;
+    struct SDyn_Node *ret = NULL;
     struct SDyn_Token tok, start;
     int type;
 
-    GGC_PUSH_1(ret);
-
     /* make sure we can rewind */
     start = *ntok;
 
     /* parse it */
-    ret = parseOrExp(ntok);
+    ret = parseOrExp(arena, ntok);
 
     /* check if it's a valid for */
-    type = GGC_RD(ret, type);
+    type = ret->type;
     if (type == SDYN_NODE_INDEX ||
         type == SDYN_NODE_MEMBER ||
         type == SDYN_NODE_VARREF)
@@ -620,38 +705,36 @@ PARSER(LValOpt)
 
 PARSER(Args)
 {
-    SDyn_Node ret = NULL, cur = NULL;
-    SDyn_NodeArray children = NULL;
-    SDyn_NodeList clist = NULL;
+    struct SDyn_Node *ret = NULL, *cur = NULL;
+    struct SDyn_NodeArray *children = NULL;
+    struct NodeList clist;
     struct SDyn_Token tok, first;
 
-    GGC_PUSH_4(ret, cur, children, clist);
-
     /* if it's just a ), no args at all */
     PEEK();
     first = tok;
     IFTOK(RPAREN) {
-        children = GGC_NEW_PA(SDyn_Node, 0);
+        children = newNodeArray(arena, 0);
         RET(ARGS, first, children);
         return ret;
     }
 
     /* otherwise, we'd best have a list of args! */
-    clist = GGC_NEW(SDyn_NodeList);
-    cur = parseExpression(ntok);
-    SDyn_NodeListPush(clist, cur);
+    nodeListInit(&clist);
+    cur = parseExpression(arena, ntok);
+    nodeListPush(arena, &clist, cur);
     while (1) {
         PEEK();
 
         IFTOK(COMMA) {
             NEXT();
 
-            cur = parseExpression(ntok);
-            SDyn_NodeListPush(clist, cur);
+            cur = parseExpression(arena, ntok);
+            nodeListPush(arena, &clist, cur);
         } else break;
     }
 
-    children = SDyn_NodeListToArray(clist);
+    children = nodeListToArray(arena, &clist);
     RET(ARGS, first, children);
 
     return ret;
@@ -659,35 +742,33 @@ PARSER(Args)
 
 PARSER(Primary)
 {
-    SDyn_Node ret = NULL;
+    struct SDyn_Node *ret = NULL;
     struct SDyn_Token tok, rep;
 
-    GGC_PUSH_1(ret);
-
     NEXT();
 
     IFTOK(ID) {
-        RET(VARREF, tok, GGC_NULL);
+        RET(VARREF, tok, NULL);
         return ret;
     } else IFTOK(NUM) {
-        RET(NUM, tok, GGC_NULL);
+        RET(NUM, tok, NULL);
         return ret;
     } else IFTOK(STR) {
-        RET(STR, tok, GGC_NULL);
+        RET(STR, tok, NULL);
         return ret;
     } else IFTOK(false) {
-        RET(FALSE, tok, GGC_NULL);
+        RET(FALSE, tok, NULL);
         return ret;
     } else IFTOK(true) {
-        RET(TRUE, tok, GGC_NULL);
+        RET(TRUE, tok, NULL);
         return ret;
     } else IFTOK(LBRACE) {
         rep = tok;
         ASSERTNEXT(RBRACE);
-        RET(OBJ, rep, GGC_NULL);
+        RET(OBJ, rep, NULL);
         return ret;
     } else IFTOK(LPAREN) {
-        ret = parseExpression(ntok);
+        ret = parseExpression(arena, ntok);
         ASSERTNEXT(RPAREN);
         return ret;
     } else ERROR();
@@ -696,25 +777,23 @@ PARSER(Primary)
 #ifdef USE_SDYN_PARSER_TEST
 #include "sja/buffer.h"
 
-static void dumpNode(size_t spcs, SDyn_Node node)
+static void dumpNode(size_t spcs, struct SDyn_Node *node)
 {
-    SDyn_NodeArray children = NULL;
+    struct SDyn_NodeArray *children;
     size_t i;
 
-    GGC_PUSH_2(node, children);
-
     for (i = 0; i < spcs; i++) printf("  ");
     if (!node) {
         printf("NULL\n");
         return;
     }
-    printf("%s: %.*s\n", sdyn_nodeNames[GGC_RD(node, type)], (int) GGC_RD(node, tok).valLen, (char *) GGC_RD(node, tok).val);
+    printf("%s: %.*s\n", sdyn_nodeNames[node->type], (int) node->tok.valLen, (char *) node->tok.val);
 
     spcs++;
-    children = GGC_RP(node, children);
+    children = node->children;
     if (children) {
         for (i = 0; i < children->length; i++) {
-            dumpNode(spcs, GGC_RAP(children, i));
+            dumpNode(spcs, children->a[i]);
         }
     }
 
@@ -723,8 +802,10 @@ static void dumpNode(size_t spcs, SDyn_Node node)
 
 int main()
 {
-    SDyn_Node node = NULL;
+    struct SDyn_Arena arena;
+    struct SDyn_Node *node;
     struct Buffer_char buf;
+
     const unsigned char *cur;
 
     INIT_BUFFER(buf);
@@ -732,10 +813,10 @@ int main()
     WRITE_ONE_BUFFER(buf, 0);
     cur = (unsigned char *) buf.buf;
 
-    GGC_PUSH_1(node);
-
-    node = sdyn_parse(cur);
+    sdyn_arenaInit(&arena);
+    node = sdyn_parse(&arena, cur);
     dumpNode(0, node);
+    sdyn_arenaFree(&arena);
 
     return 0;
 }
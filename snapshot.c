@@ -0,0 +1,228 @@
+/*
+ * SDyn: Snapshot cache of compiled functions
+ *
+ * Copyright (c) 2015 Gregor Richards
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Each compiled function's image is kept in its own file in the cache
+ * directory, named by a hash of everything its code depends on: the build of
+ * the JIT and runtime (sdyn_imageVersion and sdyn_buildStamp), the argument
+ * types it's specialized for, and its source. The file repeats all three, so
+ * a hash collision is only a miss. A file is mapped in when its function is
+ * first called, and loaded by the JIT, which relocates it. Files are written
+ * whole and renamed into place, so concurrent runs only ever see complete
+ * ones. Since loading a file runs its code, the directory and files must
+ * belong to us, and not be writable by anyone else. The cache is only an
+ * optimization, so any failure to read or write it is silent.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "sdyn/jit.h"
+#include "sdyn/snapshot.h"
+
+#define SNAPSHOT_MAGIC  "SDynSnap"
+#define SNAPSHOT_PAD(n) (((n) + sizeof(size_t) - 1) / sizeof(size_t) * sizeof(size_t))
+
+/* the header of a snapshot file, which is followed by the JIT version, the
+ * source, and the image, each padded to a word */
+struct SnapshotHeader {
+    char magic[8];
+    size_t versionLen, sourceLen, imageLen;
+    size_t arity;
+    int generic; /* 1 for the generic version, 0 if specialized by argTypes */
+    int argTypes[SDYN_SPECIALIZE_ARGS];
+};
+
+/* the cache directory, or NULL if it's not in use */
+static const char *snapshotDir;
+static int snapshotChecked;
+
+/* the version of the JIT and runtime which files must match */
+static char *snapshotVersion;
+
+/* is the snapshot cache in use? */
+int sdyn_snapshotEnabled()
+{
+    if (!snapshotChecked) {
+        snapshotChecked = 1;
+        snapshotDir = getenv(SDYN_SNAPSHOT_ENV);
+        if (snapshotDir && !snapshotDir[0]) snapshotDir = NULL;
+        if (snapshotDir) {
+            mkdir(snapshotDir, 0700);
+            snapshotVersion = malloc(strlen(sdyn_imageVersion) + strlen(sdyn_buildStamp) + 2);
+            if (snapshotVersion == NULL) {
+                perror("malloc");
+                abort();
+            }
+            sprintf(snapshotVersion, "%s %s", sdyn_imageVersion, sdyn_buildStamp);
+        }
+    }
+    return !!snapshotDir;
+}
+
+/* can only we have written this file or directory? */
+static int snapshotTrusted(struct stat *sbuf)
+{
+    return sbuf->st_uid == geteuid() && !(sbuf->st_mode & (S_IWGRP|S_IWOTH));
+}
+
+/* is the cache directory ours? */
+static int snapshotDirTrusted(void)
+{
+    struct stat sbuf;
+    return stat(snapshotDir, &sbuf) == 0 && S_ISDIR(sbuf.st_mode) && snapshotTrusted(&sbuf);
+}
+
+/* FNV-1a, continuing from this hash */
+static unsigned long snapshotHash(unsigned long hash, const void *data, size_t len)
+{
+    const unsigned char *bytes = data;
+    size_t i;
+    for (i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3UL;
+    }
+    return hash;
+}
+
+/* fill in the identifying parts of a header, and get the file it goes in.
+ * Returns 0 if the path doesn't fit. */
+static int snapshotPath(struct SnapshotHeader *hdr, const unsigned char *source,
+        size_t sourceLen, const int *argTypes, char *path, size_t pathLen)
+{
+    unsigned long hash;
+    int len;
+
+    memset(hdr, 0, sizeof(struct SnapshotHeader));
+    memcpy(hdr->magic, SNAPSHOT_MAGIC, 8);
+    hdr->versionLen = strlen(snapshotVersion);
+    hdr->sourceLen = sourceLen;
+    hdr->generic = !argTypes;
+    if (argTypes)
+        memcpy(hdr->argTypes, argTypes, sizeof(hdr->argTypes));
+
+    hash = snapshotHash(0xcbf29ce484222325UL, snapshotVersion, hdr->versionLen);
+    hash = snapshotHash(hash, &hdr->generic, sizeof(hdr->generic));
+    hash = snapshotHash(hash, hdr->argTypes, sizeof(hdr->argTypes));
+    hash = snapshotHash(hash, source, sourceLen);
+
+    len = snprintf(path, pathLen, "%s/%016lx.snap", snapshotDir, hash);
+    return len > 0 && (size_t) len < pathLen;
+}
+
+/* load a function's code from the snapshot cache */
+sdyn_native_function_t sdyn_snapshotLoad(const unsigned char *source, size_t sourceLen,
+        const int *argTypes, void **fastEntry, size_t *arity)
+{
+    struct SnapshotHeader want, *hdr;
+    char path[4096];
+    struct stat sbuf;
+    unsigned char *map;
+    size_t at;
+    int fd;
+    sdyn_native_function_t ret;
+
+    if (!sdyn_snapshotEnabled()) return NULL;
+    if (!snapshotPath(&want, source, sourceLen, argTypes, path, sizeof(path)))
+        return NULL;
+    if (!snapshotDirTrusted()) return NULL;
+
+    /* map it in, if it's ours */
+    fd = open(path, O_RDONLY|O_NOFOLLOW);
+    if (fd < 0) return NULL;
+    if (fstat(fd, &sbuf) < 0 || !S_ISREG(sbuf.st_mode) || !snapshotTrusted(&sbuf) ||
+        (size_t) sbuf.st_size < sizeof(struct SnapshotHeader)) {
+        close(fd);
+        return NULL;
+    }
+    map = mmap(NULL, sbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+
+    /* make sure it's the function we want */
+    ret = NULL;
+    hdr = (struct SnapshotHeader *) map;
+    at = sizeof(struct SnapshotHeader) + SNAPSHOT_PAD(want.versionLen) + SNAPSHOT_PAD(sourceLen);
+    if (!memcmp(hdr->magic, want.magic, 8) &&
+        hdr->versionLen == want.versionLen &&
+        hdr->sourceLen == want.sourceLen &&
+        hdr->generic == want.generic &&
+        !memcmp(hdr->argTypes, want.argTypes, sizeof(want.argTypes)) &&
+        hdr->imageLen <= (size_t) sbuf.st_size &&
+        at == (size_t) sbuf.st_size - hdr->imageLen &&
+        !memcmp(map + sizeof(struct SnapshotHeader), snapshotVersion, want.versionLen) &&
+        !memcmp(map + sizeof(struct SnapshotHeader) + SNAPSHOT_PAD(want.versionLen),
+                source, sourceLen)) {
+
+        /* then load it */
+        ret = sdyn_loadImage(map + at, hdr->imageLen, source, fastEntry);
+        if (ret && arity) *arity = hdr->arity;
+    }
+
+    munmap(map, sbuf.st_size);
+    return ret;
+}
+
+/* write bytes to a snapshot file, padded to a word */
+static int snapshotWrite(FILE *f, const void *data, size_t len)
+{
+    static const unsigned char zeroes[sizeof(size_t)];
+    return fwrite(data, 1, len, f) == len &&
+           fwrite(zeroes, 1, SNAPSHOT_PAD(len) - len, f) == SNAPSHOT_PAD(len) - len;
+}
+
+/* store a function's image in the snapshot cache */
+void sdyn_snapshotStore(const unsigned char *source, size_t sourceLen,
+        const int *argTypes, size_t arity, const unsigned char *image, size_t imageLen)
+{
+    struct SnapshotHeader hdr;
+    char path[4096], tmpPath[4096 + 32];
+    FILE *f;
+    int fd, ok;
+
+    if (!sdyn_snapshotEnabled()) return;
+    if (!snapshotPath(&hdr, source, sourceLen, argTypes, path, sizeof(path)))
+        return;
+    if (!snapshotDirTrusted()) return;
+    hdr.imageLen = imageLen;
+    hdr.arity = arity;
+
+    /* write it to the side, then move it into place */
+    sprintf(tmpPath, "%s.%ld.tmp", path, (long) getpid());
+    fd = open(tmpPath, O_WRONLY|O_CREAT|O_EXCL, 0600);
+    if (fd < 0) return;
+    f = fdopen(fd, "wb");
+    if (!f) {
+        close(fd);
+        unlink(tmpPath);
+        return;
+    }
+    ok = fwrite(&hdr, sizeof(struct SnapshotHeader), 1, f) == 1 &&
+         snapshotWrite(f, snapshotVersion, hdr.versionLen) &&
+         snapshotWrite(f, source, sourceLen) &&
+         snapshotWrite(f, image, imageLen);
+    if (fclose(f) != 0) ok = 0;
+    if (!ok || rename(tmpPath, path) != 0)
+        unlink(tmpPath);
+}
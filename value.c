@@ -25,21 +25,38 @@
 #include <string.h>
 #include <sys/mman.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "sdyn/jit.h"
+#include "sdyn/snapshot.h"
 #include "sdyn/value.h"
 
+/* concatenations at least this long are built as ropes */
+#define SDYN_ROPE_MIN 256
+
 /* map functions */
 size_t SDyn_ShapeMapStringHash(SDyn_String str)
 {
     GGC_char_Array arr = NULL;
-    size_t i, ret = 0;
+    size_t i, ret;
 
     GGC_PUSH_2(str, arr);
-    arr = GGC_RP(str, value);
+
+    /* the hash is cached in the string itself */
+    ret = GGC_RD(str, hash);
+    if (ret) return ret;
+
+    arr = sdyn_stringValue(NULL, str);
 
     for (i = 0; i < arr->length; i++)
         ret = ((unsigned char) GGC_RAD(arr, i)) + (ret << 16) - ret;
 
+    /* 0 means "not yet computed", so avoid it */
+    if (ret == 0) ret = 1;
+    GGC_WD(str, hash, ret);
+
     return ret;
 }
 
@@ -50,8 +67,17 @@ int SDyn_ShapeMapStringCmp(SDyn_String strl, SDyn_String strr)
     int ret;
 
     GGC_PUSH_4(strl, strr, arrl, arrr);
-    arrl = GGC_RP(strl, value);
-    arrr = GGC_RP(strr, value);
+
+    /* the same string is certainly equal to itself */
+    if (strl == strr) return 0;
+
+    /* and two distinct interned strings are certainly different. The maps
+     * only care about equality, so any nonzero result will do */
+    if (GGC_RD(strl, interned) && GGC_RD(strr, interned))
+        return (strl < strr) ? -1 : 1;
+
+    arrl = sdyn_stringValue(NULL, strl);
+    arrr = sdyn_stringValue(NULL, strr);
     lenl = arrl->length;
     lenr = arrr->length;
     if (lenl < lenr) minlen = lenl;
@@ -70,14 +96,53 @@ int SDyn_ShapeMapStringCmp(SDyn_String strl, SDyn_String strr)
 }
 
 /* important global values */
-SDyn_Undefined sdyn_undefined = NULL;
-SDyn_Boolean sdyn_false = NULL, sdyn_true = NULL;
+struct SDyn_Globals sdyn_globals = {NULL, NULL, NULL, NULL};
 SDyn_Shape sdyn_emptyShape = NULL;
-SDyn_Object sdyn_globalObject = NULL;
+
+/* the table of all interned strings */
+static SDyn_InternMap internTable = NULL;
+
+/* strings produced by coercions and typeof, which are all interned up front */
+enum {
+    COMMON_UNDEFINED,
+    COMMON_TRUE,
+    COMMON_FALSE,
+    COMMON_OBJECT_VALUE,
+    COMMON_FUNCTION_VALUE,
+    COMMON_ERROR,
+    COMMON_BOOLEAN,
+    COMMON_NUMBER,
+    COMMON_STRING,
+    COMMON_OBJECT,
+    COMMON_FUNCTION,
+    COMMON_UNKNOWN,
+    COMMON_LAST
+};
+static const char *commonStringValues[] = {
+    "undefined",
+    "true",
+    "false",
+    "[object Object]",
+    "[function]",
+    "[ERROR!]",
+    "boolean",
+    "number",
+    "string",
+    "object",
+    "function",
+    "???"
+};
+static SDyn_StringArray commonStrings = NULL;
+
+/* interned strings for small non-negative integers, filled in as they're
+ * needed. Indexing by integers converts them to strings all the time */
+#define SMALL_INT_STRINGS 65536
+static SDyn_StringArray smallIntStrings = NULL;
 
 static void pushGlobals()
 {
-    GGC_PUSH_5(sdyn_undefined, sdyn_false, sdyn_true, sdyn_emptyShape, sdyn_globalObject);
+    GGC_PUSH_8(sdyn_undefined, sdyn_false, sdyn_true, sdyn_emptyShape, sdyn_globalObject,
+        internTable, commonStrings, smallIntStrings);
     GGC_GLOBALIZE();
     return;
 }
@@ -92,6 +157,7 @@ void sdyn_initValues()
     SDyn_IndexMap eim = NULL;
     SDyn_UndefinedArray em = NULL;
     SDyn_Function func = NULL;
+    size_t i;
 
     GGC_PUSH_7(tag, number, string, esm, eim, em, func);
 
@@ -148,6 +214,15 @@ void sdyn_initValues()
     func = GGC_NEW(SDyn_Function);
     GGC_WUP(func, tag);
 
+    /* the intern table and the strings we always want interned */
+    internTable = GGC_NEW(SDyn_InternMap);
+    commonStrings = GGC_NEW_PA(SDyn_String, COMMON_LAST);
+    for (i = 0; i < COMMON_LAST; i++) {
+        string = sdyn_internString(NULL, (char *) commonStringValues[i], strlen(commonStringValues[i]));
+        GGC_WAP(commonStrings, i, string);
+    }
+    smallIntStrings = GGC_NEW_PA(SDyn_String, SMALL_INT_STRINGS);
+
     /* so long as we're at it, initialize our pointer stack */
 #define POINTER_STACK_SZ 8388608
     ggc_jitPointerStack = ggc_jitPointerStackTop =
@@ -158,15 +233,17 @@ void sdyn_initValues()
     return;
 }
 
-/* simple boxer for functions */
-SDyn_Function sdyn_boxFunction(SDyn_Node ast)
+/* simple boxer for functions, from a LAZYFUNDECL */
+SDyn_Function sdyn_boxFunction(struct SDyn_Node *decl)
 {
     SDyn_Function ret = NULL;
+    struct SDyn_Token source;
 
-    GGC_PUSH_1(ret);
-
+    /* just remember where it is, to be parsed when it's compiled */
     ret = GGC_NEW(SDyn_Function);
-    GGC_WP(ret, ast, ast);
+    source = decl->children->a[0]->tok;
+    GGC_WD(ret, source, source.val);
+    GGC_WD(ret, sourceLen, source.valLen);
 
     return ret;
 }
@@ -234,6 +311,120 @@ SDyn_String sdyn_boxString(void **pstack, char *value, size_t len)
     return ret;
 }
 
+/* get the interned version of a string */
+SDyn_String sdyn_intern(void **pstack, SDyn_String str)
+{
+    SDyn_String ret = NULL;
+
+    PSTACK();
+    GGC_PUSH_2(str, ret);
+
+    if (GGC_RD(str, interned)) return str;
+
+    /* if there's already an interned version, use it */
+    if (SDyn_InternMapGet(internTable, str, &ret)) return ret;
+
+    /* otherwise, this string becomes the interned version */
+    GGC_WD(str, interned, 1);
+    SDyn_InternMapPut(internTable, str, str);
+
+    return str;
+}
+
+/* box and intern a string */
+SDyn_String sdyn_internString(void **pstack, char *value, size_t len)
+{
+    SDyn_String ret = NULL;
+
+    PSTACK();
+    GGC_PUSH_1(ret);
+
+    ret = sdyn_boxString(NULL, value, len);
+    return sdyn_intern(NULL, ret);
+}
+
+/* copy a rope's characters into dest, ending at end. Doesn't allocate from the
+ * GC, so nothing moves, and the pieces yet to copy can be kept on a stack of
+ * our own. Ropes can be arbitrarily deep on either side (s = s + x leans left,
+ * s = x + s right), so they're walked with that stack rather than recursion. */
+static void flattenInto(GGC_char_Array dest, size_t end, SDyn_String str)
+{
+    GGC_char_Array part = NULL;
+    SDyn_String *stack;
+    size_t depth, capacity;
+
+    GGC_PUSH_3(dest, str, part);
+
+    capacity = 64;
+    stack = malloc(capacity * sizeof(SDyn_String));
+    if (stack == NULL) {
+        perror("malloc");
+        abort();
+    }
+    stack[0] = str;
+    depth = 1;
+
+    /* fill in from the end, so the right side of each rope goes first */
+    while (depth) {
+        str = stack[--depth];
+        part = GGC_RP(str, value);
+        if (part) {
+            end -= part->length;
+            memcpy(dest->a__data + end, part->a__data, part->length);
+            continue;
+        }
+
+        if (depth + 2 > capacity) {
+            capacity *= 2;
+            stack = realloc(stack, capacity * sizeof(SDyn_String));
+            if (stack == NULL) {
+                perror("realloc");
+                abort();
+            }
+        }
+        stack[depth++] = GGC_RP(str, left);
+        stack[depth++] = GGC_RP(str, right);
+    }
+
+    free(stack);
+}
+
+/* get the characters of a string, flattening it if it's a rope */
+GGC_char_Array sdyn_stringValue(void **pstack, SDyn_String str)
+{
+    GGC_char_Array ret = NULL;
+    size_t len;
+
+    PSTACK();
+    GGC_PUSH_2(str, ret);
+
+    ret = GGC_RP(str, value);
+    if (ret) return ret;
+
+    len = GGC_RD(str, length);
+    ret = GGC_NEW_DA(char, len);
+    flattenInto(ret, len, str);
+
+    /* now it's flat, so the pieces can go */
+    GGC_WP(str, value, ret);
+    GGC_WP(str, left, NULL);
+    GGC_WP(str, right, NULL);
+
+    return ret;
+}
+
+/* get the length of a string without flattening it */
+size_t sdyn_stringLength(SDyn_String str)
+{
+    GGC_char_Array arr = NULL;
+
+    GGC_PUSH_2(str, arr);
+
+    arr = GGC_RP(str, value);
+    if (arr) return arr->length;
+    return GGC_RD(str, length);
+}
+
 /* and a specialized boxer for quoted strings */
 SDyn_String sdyn_unquote(SDyn_String istr)
 {
@@ -243,7 +434,7 @@ SDyn_String sdyn_unquote(SDyn_String istr)
 
     GGC_PUSH_4(istr, ret, ia, reta);
 
-    ia = GGC_RP(istr, value);
+    ia = sdyn_stringValue(NULL, istr);
     reta = GGC_NEW_DA(char, ia->length);
 
     /* just look for escapes */
@@ -305,7 +496,7 @@ int sdyn_toBoolean(void **pstack, SDyn_Undefined value)
 
         case SDYN_TYPE_STRING:
             string = (SDyn_String) value;
-            return (GGC_RP(string, value)->length) ? 1 : 0;
+            return sdyn_stringLength(string) ? 1 : 0;
 
         default:
             return 1;
@@ -344,7 +535,12 @@ long sdyn_toNumber(void **pstack, SDyn_Undefined value)
             long val = 0;
             int sign = 1;
             string = (SDyn_String) value;
-            strRaw = GGC_RP(string, value);
+
+            /* strings remember their numeric value once it's known */
+            if (GGC_RD(string, hasNumber))
+                return GGC_RD(string, number);
+
+            strRaw = sdyn_stringValue(NULL, string);
             i = 0;
             if (GGC_RAD(strRaw, 0) == '-') {
                 sign = -1;
@@ -357,7 +553,10 @@ long sdyn_toNumber(void **pstack, SDyn_Undefined value)
                     val += (c - '0');
                 } else break;
             }
-            return sign * val;
+            val *= sign;
+            GGC_WD(string, number, val);
+            GGC_WD(string, hasNumber, 1);
+            return val;
         }
 
         default:
@@ -369,13 +568,11 @@ long sdyn_toNumber(void **pstack, SDyn_Undefined value)
 SDyn_String sdyn_toString(void **pstack, SDyn_Undefined value)
 {
     SDyn_Tag tag = NULL;
-    SDyn_String ret = NULL;
-    GGC_char_Array ca = NULL;
     SDyn_Boolean boolean = NULL;
     SDyn_Number number = NULL;
 
     PSTACK();
-    GGC_PUSH_6(value, tag, ret, ca, boolean, number);
+    GGC_PUSH_4(value, tag, boolean, number);
 
     tag = (SDyn_Tag) GGC_RUP(value);
     switch (GGC_RD(tag, type)) {
@@ -383,94 +580,90 @@ SDyn_String sdyn_toString(void **pstack, SDyn_Undefined value)
             return (SDyn_String) value;
 
         case SDYN_TYPE_BOXED_UNDEFINED:
-        {
-            static const char sundefined[] = "undefined";
-            ca = GGC_NEW_DA(char, sizeof(sundefined)-1);
-            memcpy(ca->a__data, sundefined, sizeof(sundefined)-1);
-            break;
-        }
+            return GGC_RAP(commonStrings, COMMON_UNDEFINED);
 
         case SDYN_TYPE_BOXED_BOOL:
-        {
-            static const char strue[] = "true";
-            static const char sfalse[] = "false";
             boolean = (SDyn_Boolean) value;
-            if (GGC_RD(boolean, value)) {
-                ca = GGC_NEW_DA(char, sizeof(strue)-1);
-                memcpy(ca->a__data, strue, sizeof(strue)-1);
-            } else {
-                ca = GGC_NEW_DA(char, sizeof(sfalse)-1);
-                memcpy(ca->a__data, sfalse, sizeof(sfalse)-1);
-            }
-            break;
-        }
+            if (GGC_RD(boolean, value))
+                return GGC_RAP(commonStrings, COMMON_TRUE);
+            else
+                return GGC_RAP(commonStrings, COMMON_FALSE);
 
         case SDYN_TYPE_BOXED_INT:
-        {
-            size_t len;
-            long val, tmp;
-            int negative;
             number = (SDyn_Number) value;
-
-            /* first determine the necessary length */
-            val = GGC_RD(number, value);
-            negative = (val<0);
-            if (negative) {
-                val *= -1;
-                len = 1;
-            } else {
-                len = 0;
-            }
-            tmp = val;
-            if (val == 0) len++;
-            else for (; tmp; len++) tmp /= 10;
-
-            /* now allocate that length */
-            ca = GGC_NEW_DA(char, len);
-
-            /* and convert */
-            for (len--; len > 0; len--) {
-                char c = (val % 10) + '0';
-                GGC_WAD(ca, len, c);
-                val /= 10;
-            }
-            if (negative) {
-                char c = '-';
-                GGC_WAD(ca, 0, c);
-            } else {
-                char c = (val % 10) + '0';
-                GGC_WAD(ca, 0, c);
-            }
-            break;
-        }
+            return sdyn_intToString(NULL, GGC_RD(number, value));
 
         case SDYN_TYPE_OBJECT:
-        {
-            static const char sobject[] = "[object Object]";
-            ca = GGC_NEW_DA(char, sizeof(sobject)-1);
-            memcpy(ca->a__data, sobject, sizeof(sobject)-1);
-            break;
-        }
+            return GGC_RAP(commonStrings, COMMON_OBJECT_VALUE);
 
         case SDYN_TYPE_FUNCTION:
-        {
-            static const char sfunction[] = "[function]";
-            ca = GGC_NEW_DA(char, sizeof(sfunction)-1);
-            memcpy(ca->a__data, sfunction, sizeof(sfunction)-1);
-            break;
-        }
+            return GGC_RAP(commonStrings, COMMON_FUNCTION_VALUE);
 
         default:
-        {
-            static const char serror[] = "[ERROR!]";
-            ca = GGC_NEW_DA(char, sizeof(serror)-1);
-            memcpy(ca->a__data, serror, sizeof(serror)-1);
-        }
+            return GGC_RAP(commonStrings, COMMON_ERROR);
+    }
+}
+
+/* convert an integer to a string */
+SDyn_String sdyn_intToString(void **pstack, long value)
+{
+    static const char digitPairs[] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+    SDyn_String ret = NULL;
+    GGC_char_Array ca = NULL;
+    char buf[24];
+    char *cur = buf + sizeof(buf);
+    unsigned long uval;
+    int small;
+
+    PSTACK();
+    GGC_PUSH_2(ret, ca);
+
+    /* small numbers are cached */
+    small = (value >= 0 && value < SMALL_INT_STRINGS);
+    if (small) {
+        ret = GGC_RAP(smallIntStrings, value);
+        if (ret) return ret;
+    }
+
+    /* convert from the end, two digits at a time */
+    uval = (value < 0) ? -(unsigned long) value : (unsigned long) value;
+    while (uval >= 100) {
+        unsigned long pair = (uval % 100) * 2;
+        uval /= 100;
+        *--cur = digitPairs[pair + 1];
+        *--cur = digitPairs[pair];
     }
+    if (uval >= 10) {
+        *--cur = digitPairs[uval * 2 + 1];
+        *--cur = digitPairs[uval * 2];
+    } else {
+        *--cur = '0' + uval;
+    }
+    if (value < 0) *--cur = '-';
 
-    /* now convert the character array into a string */
+    /* box it up, knowing its numeric value already */
+    ca = GGC_NEW_DA(char, buf + sizeof(buf) - cur);
+    memcpy(ca->a__data, cur, ca->length);
     ret = GGC_NEW(SDyn_String);
     GGC_WP(ret, value, ca);
+    GGC_WD(ret, number, value);
+    GGC_WD(ret, hasNumber, 1);
+
+    if (small) {
+        ret = sdyn_intern(NULL, ret);
+        GGC_WAP(smallIntStrings, value, ret);
+    }
 
     return ret;
 }
@@ -529,36 +722,22 @@ SDyn_Function sdyn_assertFunction(void **pstack, SDyn_Function func)
 SDyn_String sdyn_typeof(void **pstack, SDyn_Undefined value)
 {
     SDyn_Tag tag = NULL;
-    GGC_char_Array reta = NULL;
-    SDyn_String ret = NULL;
 
     PSTACK();
-    GGC_PUSH_4(value, tag, reta, ret);
+    GGC_PUSH_2(value, tag);
 
     tag = (SDyn_Tag) GGC_RUP(value);
 
-    /* macro to load a string into GGC */
-#define LSTR(str) do { \
-    reta = GGC_NEW_DA(char, sizeof(str)-1); \
-    memcpy(reta->a__data, str, sizeof(str)-1); \
-} while(0)
-
-    /* make our string return */
+    /* all the results are interned already */
     switch (GGC_RD(tag, type)) {
-        case SDYN_TYPE_BOXED_UNDEFINED: LSTR("undefined"); break;
-        case SDYN_TYPE_BOXED_BOOL:      LSTR("boolean"); break;
-        case SDYN_TYPE_BOXED_INT:       LSTR("number"); break;
-        case SDYN_TYPE_STRING:          LSTR("string"); break;
-        case SDYN_TYPE_OBJECT:          LSTR("object"); break;
-        case SDYN_TYPE_FUNCTION:        LSTR("function"); break;
-        default:                        LSTR("???"); break;
+        case SDYN_TYPE_BOXED_UNDEFINED: return GGC_RAP(commonStrings, COMMON_UNDEFINED);
+        case SDYN_TYPE_BOXED_BOOL:      return GGC_RAP(commonStrings, COMMON_BOOLEAN);
+        case SDYN_TYPE_BOXED_INT:       return GGC_RAP(commonStrings, COMMON_NUMBER);
+        case SDYN_TYPE_STRING:          return GGC_RAP(commonStrings, COMMON_STRING);
+        case SDYN_TYPE_OBJECT:          return GGC_RAP(commonStrings, COMMON_OBJECT);
+        case SDYN_TYPE_FUNCTION:        return GGC_RAP(commonStrings, COMMON_FUNCTION);
+        default:                        return GGC_RAP(commonStrings, COMMON_UNKNOWN);
     }
-
-    /* and box it */
-    ret = GGC_NEW(SDyn_String);
-    GGC_WP(ret, value, reta);
-
-    return ret;
 }
 
 /* get the index to which a member belongs in this object, creating one if requested */
@@ -588,6 +767,9 @@ size_t sdyn_getObjectMemberIndex(void **pstack, SDyn_Object object, SDyn_String
     /* nope! Do we stop here? */
     if (!create) return (size_t) -1;
 
+    /* shapes outlive most member names, so keep only the interned copy */
+    member = sdyn_intern(NULL, member);
+
     /* expand the object */
     oldObjectMembers = GGC_RP(object, members);
     ret = oldObjectMembers->length;
@@ -655,6 +837,51 @@ void sdyn_setObjectMember(void **pstack, SDyn_Object object, SDyn_String member,
     return;
 }
 
+/* set a member of an object by name, filling a member cache */
+void sdyn_setObjectMemberCached(void **pstack, SDyn_Object object, SDyn_Undefined value, struct SDyn_MemberCache *cache)
+{
+    SDyn_Shape shape = NULL;
+    SDyn_UndefinedArray members = NULL;
+    size_t idx;
+
+    PSTACK();
+    GGC_PUSH_4(object, value, shape, members);
+
+    shape = GGC_RP(object, shape);
+    idx = sdyn_getObjectMemberIndex(NULL, object, *cache->member, 1);
+    members = GGC_RP(object, members);
+    GGC_WAP(members, idx, value);
+
+    /* only an existing member can be cached, since adding one changes the
+     * shape */
+    if (GGC_RP(object, shape) == shape) {
+        *cache->shape = shape;
+        cache->index = idx;
+    }
+
+    return;
+}
+
+/* compare two character arrays of the same length for equality */
+static int charsEqual(const char *l, const char *r, size_t len)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    /* sixteen bytes at a time */
+    for (; i + 16 <= len; i += 16) {
+        __m128i lv = _mm_loadu_si128((const __m128i *) (l + i));
+        __m128i rv = _mm_loadu_si128((const __m128i *) (r + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(lv, rv)) != 0xFFFF) return 0;
+    }
+#endif
+
+    for (; i < len; i++)
+        if (l[i] != r[i]) return 0;
+
+    return 1;
+}
+
 /* the ever-complicated add function */
 SDyn_Undefined sdyn_add(void **pstack, SDyn_Undefined left, SDyn_Undefined right)
 {
@@ -662,6 +889,7 @@ SDyn_Undefined sdyn_add(void **pstack, SDyn_Undefined left, SDyn_Undefined right
     SDyn_Number ln = NULL, rn = NULL;
     SDyn_String ls = NULL, rs = NULL, rets = NULL;
     GGC_char_Array lsa = NULL, rsa = NULL, retsa = NULL;
+    size_t llen, rlen;
 
     PSTACK();
     GGC_PUSH_12(left, right, ltag, rtag, ln, rn, ls, rs, rets, lsa, rsa, retsa);
@@ -681,10 +909,24 @@ SDyn_Undefined sdyn_add(void **pstack, SDyn_Undefined left, SDyn_Undefined right
     /* need to convert to strings */
     ls = sdyn_toString(NULL, left);
     rs = sdyn_toString(NULL, right);
+    llen = sdyn_stringLength(ls);
+    rlen = sdyn_stringLength(rs);
+    if (llen == 0) return (SDyn_Undefined) rs;
+    if (rlen == 0) return (SDyn_Undefined) ls;
+
+    /* long results are built lazily as ropes, so that repeated appending
+     * doesn't copy the whole string every time */
+    if (llen + rlen >= SDYN_ROPE_MIN) {
+        rets = GGC_NEW(SDyn_String);
+        GGC_WP(rets, left, ls);
+        GGC_WP(rets, right, rs);
+        GGC_WD(rets, length, llen + rlen);
+        return (SDyn_Undefined) rets;
+    }
+
+    /* short ones are simply concatenated */
     lsa = GGC_RP(ls, value);
     rsa = GGC_RP(rs, value);
-
-    /* and concatenate them */
     retsa = GGC_NEW_DA(char, lsa->length + rsa->length);
     memcpy(retsa->a__data, lsa->a__data, lsa->length);
     memcpy(retsa->a__data + lsa->length, rsa->a__data, rsa->length);
@@ -767,23 +1009,23 @@ int sdyn_equal(void **pstack, SDyn_Undefined left, SDyn_Undefined right)
 
             case SDYN_TYPE_STRING:
             {
-                size_t i;
-
                 lstr = (SDyn_String) left;
                 rstr = (SDyn_String) right;
-                lstra = GGC_RP(lstr, value);
-                rstra = GGC_RP(rstr, value);
+
+                /* identical strings are trivially equal, and distinct interned strings trivially aren't */
+                if (lstr == rstr) return 1;
+                if (GGC_RD(lstr, interned) && GGC_RD(rstr, interned)) return 0;
+                if (GGC_RD(lstr, hash) && GGC_RD(rstr, hash) &&
+                    GGC_RD(lstr, hash) != GGC_RD(rstr, hash)) return 0;
 
                 /* first off, if they're not the same length, they can't be equal */
-                if (lstra->length != rstra->length) return 0;
+                if (sdyn_stringLength(lstr) != sdyn_stringLength(rstr)) return 0;
 
-                /* look for differences */
-                for (i = 0; i < lstra->length; i++) {
-                    if (GGC_RAD(lstra, i) != GGC_RAD(rstra, i)) return 0;
-                }
+                lstra = sdyn_stringValue(NULL, lstr);
+                rstra = sdyn_stringValue(NULL, rstr);
 
-                /* identical */
-                return 1;
+                /* look for differences */
+                return charsEqual(lstra->a__data, rstra->a__data, lstra->length);
             }
 
             default:
@@ -830,32 +1072,130 @@ int sdyn_equal(void **pstack, SDyn_Undefined left, SDyn_Undefined right)
     return 0;
 }
 
+/* compile a function, specialized to the given argument types if argTypes
+ * isn't NULL. If spec isn't NULL, its fast entry point and arity are set. */
+static sdyn_native_function_t compileFunction(SDyn_Function func, const int *argTypes, struct SDyn_Specialization *spec)
+{
+    struct SDyn_Arena arena;
+    struct SDyn_Node *ast;
+    struct SDyn_IR *ir;
+    sdyn_native_function_t nfunc;
+    unsigned char *image;
+    size_t imageLen, arity;
+
+    GGC_PUSH_1(func);
+
+    /* perhaps an earlier run compiled it already */
+    nfunc = sdyn_snapshotLoad(GGC_RD(func, source), GGC_RD(func, sourceLen),
+        argTypes, spec ? &spec->fast : NULL, &arity);
+    if (nfunc) {
+        if (spec) spec->arity = arity;
+        return nfunc;
+    }
+
+    /* the parse tree and IR only live as long as this compilation */
+    sdyn_arenaInit(&arena);
+    ast = sdyn_parseFunction(&arena, GGC_RD(func, source));
+    ir = sdyn_irCompile(&arena, ast, argTypes, NULL);
+    image = NULL;
+    imageLen = 0;
+    nfunc = sdyn_compile(ir, spec ? &spec->fast : NULL,
+        sdyn_snapshotEnabled() ? &image : NULL, &imageLen);
+    arity = ast->children->a[0]->children->length + 1;
+    if (spec) spec->arity = arity;
+    sdyn_arenaFree(&arena);
+
+    /* and keep it for later runs */
+    if (image) {
+        sdyn_snapshotStore(GGC_RD(func, source), GGC_RD(func, sourceLen),
+            argTypes, arity, image, imageLen);
+        free(image);
+    }
+
+    return nfunc;
+}
+
 /* assert that a function is compiled */
 sdyn_native_function_t sdyn_assertCompiled(void **pstack, SDyn_Function func)
 {
-    SDyn_IRNodeArray ir = NULL;
     sdyn_native_function_t nfunc;
 
     PSTACK();
-    GGC_PUSH_2(func, ir);
+    GGC_PUSH_1(func);
 
     /* need to compile? */
     nfunc = GGC_RD(func, value);
     if (!nfunc) {
-        /* need to IR-compile? */
-        ir = GGC_RP(func, irValue);
-        if (!ir) {
-            ir = sdyn_irCompile(GGC_RP(func, ast), NULL);
-            GGC_WP(func, irValue, ir);
-        }
-
-        nfunc = sdyn_compile(ir);
+        nfunc = compileFunction(func, NULL, NULL);
         GGC_WD(func, value, nfunc);
     }
 
     return nfunc;
 }
 
+/* find or compile the specialization of a function for these arguments, or
+ * NULL if it has too many versions already */
+static struct SDyn_Specialization *specialize(SDyn_Function func, size_t argCt, SDyn_Undefined *args)
+{
+    struct SDyn_Specialization *spec;
+    int argTypes[SDYN_SPECIALIZE_ARGS];
+    unsigned long signature;
+    size_t i;
+
+    GGC_PUSH_1(func);
+
+    /* the signature is the type tags of the leading arguments, four bits
+     * each. Missing arguments are undefined. */
+    signature = 0;
+    for (i = 0; i < SDYN_SPECIALIZE_ARGS; i++) {
+        if (i < argCt)
+            argTypes[i] = GGC_RD((SDyn_Tag) GGC_RUP(args[i]), type);
+        else
+            argTypes[i] = SDYN_TYPE_BOXED_UNDEFINED;
+        signature = (signature << 4) | argTypes[i];
+    }
+
+    /* perhaps we already have it */
+    for (spec = GGC_RD(func, specializations); spec; spec = spec->next) {
+        if (spec->signature == signature)
+            return spec;
+    }
+
+    /* too many versions already */
+    if (GGC_RD(func, specializationCount) >= SDYN_MAX_SPECIALIZATIONS)
+        return NULL;
+
+    /* compile a new version */
+    spec = malloc(sizeof(struct SDyn_Specialization));
+    if (spec == NULL) {
+        perror("malloc");
+        abort();
+    }
+    spec->signature = signature;
+    spec->value = compileFunction(func, argTypes, spec);
+    spec->next = GGC_RD(func, specializations);
+    GGC_WD(func, specializations, spec);
+    GGC_WD(func, specializationCount, GGC_RD(func, specializationCount) + 1);
+
+    return spec;
+}
+
+/* assert that a function is compiled, specialized to these arguments if possible */
+sdyn_native_function_t sdyn_assertSpecialized(void **pstack, SDyn_Function func, size_t argCt, SDyn_Undefined *args)
+{
+    struct SDyn_Specialization *spec;
+
+    PSTACK();
+    GGC_PUSH_1(func);
+
+    spec = specialize(func, argCt, args);
+    if (spec)
+        return spec->value;
+
+    /* settle for the generic version */
+    return sdyn_assertCompiled(NULL, func);
+}
+
 /* call a function, with JIT compilation */
 SDyn_Undefined sdyn_call(void **pstack, SDyn_Function func, size_t argCt, SDyn_Undefined *args)
 {
@@ -864,7 +1204,55 @@ SDyn_Undefined sdyn_call(void **pstack, SDyn_Function func, size_t argCt, SDyn_U
     PSTACK();
     GGC_PUSH_1(func);
 
-    nfunc = sdyn_assertCompiled(NULL, func);
+    nfunc = sdyn_assertSpecialized(NULL, func, argCt, args);
 
     return nfunc(ggc_jitPointerStack, argCt, args);
 }
+
+/* call a function from a call site with a call cache. The call site only uses
+ * its cache if the types of its arguments are known, so they always match
+ * the specialization we remember here. */
+SDyn_Undefined sdyn_callCached(void **pstack, SDyn_Function func, size_t argCt, SDyn_Undefined *args, struct SDyn_CallCache *cache)
+{
+    struct SDyn_Specialization *spec;
+
+    PSTACK();
+    GGC_PUSH_1(func);
+
+    func = sdyn_assertFunction(NULL, func);
+    spec = specialize(func, argCt, args);
+    if (!spec)
+        return sdyn_call(NULL, func, argCt, args);
+
+    /* the fast entry point doesn't fill in missing arguments */
+    if (spec->fast && argCt >= spec->arity) {
+        cache->source = GGC_RD(func, source);
+        cache->fast = spec->fast;
+    }
+
+    return spec->value(ggc_jitPointerStack, argCt, args);
+}
+
+/* call a method from a call site with a method cache, filling the cache. The
+ * receiver is the first argument, as well as object. */
+SDyn_Undefined sdyn_callMethod(void **pstack, SDyn_Undefined object, size_t argCt, SDyn_Undefined *args, struct SDyn_MethodCache *cache)
+{
+    SDyn_Object obj = NULL;
+    SDyn_Undefined func = NULL;
+    size_t idx;
+
+    PSTACK();
+    GGC_PUSH_3(object, obj, func);
+
+    obj = sdyn_toObject(NULL, object);
+    idx = sdyn_getObjectMemberIndex(NULL, obj, *cache->member, 0);
+    if (idx == (size_t) -1) {
+        func = sdyn_undefined;
+    } else {
+        func = GGC_RAP(GGC_RP(obj, members), idx);
+        *cache->shape = GGC_RP(obj, shape);
+        cache->index = idx;
+    }
+
+    return sdyn_callCached(NULL, (SDyn_Function) func, argCt, args, &cache->call);
+}